@@ -2,10 +2,24 @@ include(FindPackageHandleStandardArgs)
 
 find_path(JPEGXL_INCLUDE_DIR jxl/version.h)
 find_library(JPEGXL_LIBRARY NAMES jxl)
+find_library(JPEGXL_THREADS_LIBRARY NAMES jxl_threads)
+
+if(JPEGXL_INCLUDE_DIR)
+    file(STRINGS "${JPEGXL_INCLUDE_DIR}/jxl/version.h" JPEGXL_VERSION_LINES
+         REGEX "^#define JPEGXL_(MAJOR|MINOR|PATCH)_VERSION +[0-9]+"
+    )
+    foreach(COMPONENT MAJOR MINOR PATCH)
+        string(REGEX REPLACE ".*#define JPEGXL_${COMPONENT}_VERSION +([0-9]+).*" "\\1" JPEGXL_VERSION_${COMPONENT}
+                             "${JPEGXL_VERSION_LINES}"
+        )
+    endforeach()
+    set(JPEGXL_VERSION "${JPEGXL_VERSION_MAJOR}.${JPEGXL_VERSION_MINOR}.${JPEGXL_VERSION_PATCH}")
+endif()
 
 find_package_handle_standard_args(
     JPEGXL
-    REQUIRED_VARS JPEGXL_LIBRARY JPEGXL_INCLUDE_DIR
+    REQUIRED_VARS JPEGXL_LIBRARY JPEGXL_THREADS_LIBRARY JPEGXL_INCLUDE_DIR
+    VERSION_VAR JPEGXL_VERSION
     HANDLE_COMPONENTS
 )
 
@@ -15,6 +29,7 @@ if(JPEGXL_FOUND AND NOT TARGET JPEGXL::JPEGXL)
     set_target_properties(
         JPEGXL::JPEGXL PROPERTIES IMPORTED_LINK_INTERFACE_LANGUAGES "CXX" IMPORTED_LOCATION "${JPEGXL_LIBRARY}"
     )
+    set_target_properties(JPEGXL::JPEGXL PROPERTIES INTERFACE_LINK_LIBRARIES "${JPEGXL_THREADS_LIBRARY}")
 endif()
 
-mark_as_advanced(JPEGXL_LIBRARY JPEGXL_INCLUDE_DIR)
+mark_as_advanced(JPEGXL_LIBRARY JPEGXL_THREADS_LIBRARY JPEGXL_INCLUDE_DIR)
@@ -73,6 +73,8 @@ RawImage *decode_buffer(const unsigned char *buffer, uintptr_t buffer_size, char
 
 void free_image(RawImage *decoded_image);
 
+void free_error(char *error_msg);
+
 }  // extern "C"
 
 }  // namespace rawler
@@ -122,18 +122,17 @@ pub unsafe extern "C" fn decode_buffer(
             Err(err) => return Err(format!("Failed to decode raw image: {}", err)),
         };
 
-        // Process the image data
+        // Process the image data. It is converted to a boxed slice, so that its capacity equals its length and it
+        // can be freed from its pointer and length only.
         let (data_type, data_ptr, data_len) = match raw_image.data {
             rawler::RawImageData::Integer(data) => {
                 let len = data.len();
-                let ptr = data.as_ptr();
-                std::mem::forget(data);
+                let ptr = Box::into_raw(data.into_boxed_slice());
                 (DataType::Integer, ptr as *const c_void, len)
             }
             rawler::RawImageData::Float(data) => {
                 let len = data.len();
-                let ptr = data.as_ptr();
-                std::mem::forget(data);
+                let ptr = Box::into_raw(data.into_boxed_slice());
                 (DataType::Float, ptr as *const c_void, len)
             }
         };
@@ -253,21 +252,29 @@ pub unsafe extern "C" fn free_image(decoded_image: *mut RawImage) {
         let decoded_image = Box::from_raw(decoded_image);
 
         // Free the image data
-        match decoded_image.data_type {
-            DataType::Integer => {
-                drop(Vec::from_raw_parts(
-                    decoded_image.data_ptr as *mut u16,
-                    decoded_image.data_len,
-                    decoded_image.data_len,
-                ));
-            }
-            DataType::Float => {
-                drop(Vec::from_raw_parts(
-                    decoded_image.data_ptr as *mut f32,
-                    decoded_image.data_len,
-                    decoded_image.data_len,
-                ));
+        if !decoded_image.data_ptr.is_null() {
+            match decoded_image.data_type {
+                DataType::Integer => {
+                    drop(Box::from_raw(std::ptr::slice_from_raw_parts_mut(
+                        decoded_image.data_ptr as *mut u16,
+                        decoded_image.data_len,
+                    )));
+                }
+                DataType::Float => {
+                    drop(Box::from_raw(std::ptr::slice_from_raw_parts_mut(
+                        decoded_image.data_ptr as *mut f32,
+                        decoded_image.data_len,
+                    )));
+                }
             }
         }
     }
 }
+
+// Free an error message allocated by Rust
+#[no_mangle]
+pub unsafe extern "C" fn free_error(error_msg: *mut c_char) {
+    if !error_msg.is_null() {
+        drop(std::ffi::CString::from_raw(error_msg));
+    }
+}
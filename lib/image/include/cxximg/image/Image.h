@@ -25,6 +25,7 @@
 #include <cassert>
 #include <cstdint>
 #include <cstring>
+#include <functional>
 #include <memory>
 #include <type_traits>
 
@@ -155,11 +156,30 @@ public:
         return unallocated;
     }
 
+    /// Constructs an image instance that takes ownership of an already allocated buffer, without any copy.
+    /// The buffer must hold the layout required buffer size, and is given to the release function on destruction.
+    static Image<T> adopted(const LayoutDescriptor &layout, T *buffer, std::function<void(T *)> release) {
+        Image<T> adopted;
+        adopted.setDescriptor(ImageDescriptor<T>(LayoutDescriptor::Builder(layout).build(), nullptr));
+
+        adopted.mSize = adopted.layoutDescriptor().requiredBufferSize();
+        adopted.mData = std::unique_ptr<T[], Deleter>(buffer, Deleter{adopted.mSize, std::move(release)});
+
+        adopted.mapBuffer(buffer);
+        return adopted;
+    }
+
 private:
     struct Deleter final {
         int64_t size = 0;
+        std::function<void(T *)> release; // custom release of adopted buffers
 
         void operator()(T *ptr) const {
+            if (release) {
+                release(ptr);
+                return;
+            }
+
             auto &allocator = memory::detail::AllocatorManager::current();
             allocator.deallocate(ptr, size * sizeof(T));
         }
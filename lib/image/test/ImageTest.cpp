@@ -171,3 +171,35 @@ TYPED_TEST(ImageTest, TestCloneRoi) {
     // Then all original image values are 0
     this->image.forEach([&](int x, int y, int n) { ASSERT_EQ(this->image(x, y, n), TypeParam(0)); });
 }
+
+TYPED_TEST(ImageTest, TestAdopted) {
+    // Given I have a buffer filled with 1
+    const LayoutDescriptor layout = LayoutDescriptor::Builder(W, H).numPlanes(N).build();
+    auto *buffer = new TypeParam[layout.requiredBufferSize()];
+    std::fill_n(buffer, layout.requiredBufferSize(), TypeParam(1));
+
+    int numReleases = 0;
+    {
+        // When I adopt the buffer
+        Image<TypeParam> adopted = Image<TypeParam>::adopted(layout, buffer, [&](TypeParam *ptr) {
+            ++numReleases;
+            delete[] ptr;
+        });
+
+        // When I move the image
+        Image<TypeParam> moved = std::move(adopted);
+
+        // Then the image data is the buffer
+        ASSERT_EQ(moved.data(), buffer);
+        ASSERT_EQ(moved.size(), layout.requiredBufferSize());
+
+        // Then all the values are 1
+        moved.forEach([&](int x, int y, int n) { ASSERT_EQ(moved(x, y, n), TypeParam(1)); });
+
+        // Then the buffer is not released yet
+        ASSERT_EQ(numReleases, 0);
+    }
+
+    // Then the buffer is released once the image is destroyed
+    ASSERT_EQ(numReleases, 1);
+}
@@ -17,10 +17,14 @@
 #include "cxximg/io/ImageReader.h"
 #include "cxximg/io/ImageWriter.h"
 
+#include <exception>
+#include <functional>
 #include <istream>
 #include <memory>
 #include <ostream>
 #include <string>
+#include <variant>
+#include <vector>
 
 namespace cxximg {
 
@@ -53,6 +57,29 @@ std::unique_ptr<ImageWriter> makeWriter(const std::string &path,
                                         std::ostream *stream,
                                         const ImageWriter::Options &options = {});
 
+/// Image decoded by decodeBatch().
+struct BatchImage final {
+    std::string path;
+    std::optional<ImageMetadata> metadata;
+    std::variant<std::monostate, Image8u, Image16u, Imagef> image; // empty if decoding failed
+    std::exception_ptr error;                                      // set if decoding failed
+};
+
+/// Options of decodeBatch().
+struct BatchOptions final {
+    ImageReader::Options readOptions; // options of each reader
+    int numThreads = 0;               // number of decoding threads, 0 means all available cores
+    int64_t memoryBudget = 0;         // maximum size in bytes of the decoded images in flight, 0 means unlimited
+};
+
+/// Decodes the given files on a pool of threads and passes each decoded image to the callback in completion order.
+/// The callback is called on the calling thread, one image at a time. A decoded image counts against the memory budget
+/// until the callback returns. Camera raw files are decoded when their reader is created, before waiting for the budget.
+/// If the callback throws, pending decodes are abandoned and the exception is rethrown.
+void decodeBatch(const std::vector<std::string> &paths,
+                 const std::function<void(BatchImage &&)> &callback,
+                 const BatchOptions &options = {});
+
 } // namespace io
 
 } // namespace cxximg
@@ -17,10 +17,15 @@
 #include "cxximg/io/Exceptions.h"
 
 #include "cxximg/image/Image.h"
+#include "cxximg/math/Rect.h"
 #include "cxximg/model/ExifMetadata.h"
 #include "cxximg/model/ImageMetadata.h"
 
+#include <algorithm>
+#include <cstddef>
 #include <fstream>
+#include <functional>
+#include <iterator>
 #include <memory>
 #include <optional>
 #include <string>
@@ -28,15 +33,29 @@
 
 namespace cxximg {
 
+template <typename T>
+class FrameRange;
+
 /// Abstract image reader class.
 /// @ingroup io
 class ImageReader {
 public:
-    enum class JpegDecodingMode { YUV, RGB };
+    enum class JpegDecodingMode {
+        YUV,     ///< Interleaved YUV, with upsampled chroma
+        YUV_420, ///< YUV_420 planes, without chroma upsampling when the image is 4:2:0 subsampled
+        RGB      ///< Interleaved RGB
+    };
 
     struct Options final {
         ImageMetadata::FileInfo fileInfo;
         JpegDecodingMode jpegDecodingMode = JpegDecodingMode::RGB;
+        int numThreads = 1;    // 0 means all available cores
+        bool prefetch = false; // decode the next frame or band of rows in the background while using the current one
+
+        // Decoding hints, ignored by readers that do not support them. Resulting dimensions are reported by
+        // layoutDescriptor() once initialized, the region of a CFA image may be extended to start on the CFA period.
+        std::optional<Rect> roi; // region to decode, in full resolution coordinates
+        int downscale = 1;       // downscaling factor
 
         Options() = default;
 
@@ -47,6 +66,10 @@ public:
         }
     };
 
+    /// Callback receiving the rows [y, y + rows.height()) of the image, as a view valid until the callback returns.
+    template <typename T>
+    using RowCallback = std::function<void(int y, const ImageView<T> &rows)>;
+
     /// Constructs with stream and options.
     ImageReader(std::string path, std::istream* stream, Options options)
         : mStream(stream), mPath(std::move(path)), mOptions(options) {
@@ -75,6 +98,26 @@ public:
         return mDescriptor->layout;
     }
 
+    /// Returns the number of resolution levels stored in the image, including the full resolution one.
+    /// The downscale hint selects the smallest level at least as large as the downscaled image.
+    virtual int numLevels() const { return 1; }
+
+    /// Returns the number of frames stored in the image, e.g. the pages of a multi-page TIFF.
+    virtual int numFrames() const { return 1; }
+
+    /// Selects the frame decoded by subsequent reads. The layout descriptor is updated accordingly.
+    virtual void selectFrame(int index) {
+        if (index != 0) {
+            throw IOError("This format does not support multiple frames.");
+        }
+    }
+
+    /// Returns a range iterating over the frames of the image, each frame being decoded on dereference.
+    template <typename T>
+    FrameRange<T> frames() {
+        return FrameRange<T>(this);
+    }
+
     /// Initialize the reader.
     /// Implementations must read the image header and fill descriptor required values.
     virtual void initialize() = 0;
@@ -88,6 +131,51 @@ public:
     /// Read and decode the opened stream into a newly allocated float image.
     virtual Imagef readf() { throw IOError("This format does not support float read."); }
 
+    /// Read and decode the given region of the opened stream into a newly allocated 8 bits image.
+    /// Region coordinates are relative to layoutDescriptor(). The default implementation decodes the whole image.
+    virtual Image8u readRegion8u(const Rect& region) { return image::clone(read8u()[checkRegion(region)]); }
+
+    /// Read and decode the given region of the opened stream into a newly allocated 16 bits image.
+    /// Region coordinates are relative to layoutDescriptor(). The default implementation decodes the whole image.
+    virtual Image16u readRegion16u(const Rect& region) { return image::clone(read16u()[checkRegion(region)]); }
+
+    /// Read and decode the given region of the opened stream into a newly allocated float image.
+    /// Region coordinates are relative to layoutDescriptor(). The default implementation decodes the whole image.
+    virtual Imagef readRegionf(const Rect& region) { return image::clone(readf()[checkRegion(region)]); }
+
+    /// Read and decode the opened stream into the given 8 bits view, which may be planar, padded or bordered.
+    /// The view must have the dimensions and number of planes of layoutDescriptor(). The default implementation decodes
+    /// into a newly allocated image, then copies it.
+    virtual void readInto8u(ImageView8u image) { checkOutput(image) = read8u(); }
+
+    /// Read and decode the opened stream into the given 16 bits view, which may be planar, padded or bordered.
+    /// The view must have the dimensions and number of planes of layoutDescriptor(). The default implementation decodes
+    /// into a newly allocated image, then copies it.
+    virtual void readInto16u(ImageView16u image) { checkOutput(image) = read16u(); }
+
+    /// Read and decode the opened stream into the given float view, which may be planar, padded or bordered.
+    /// The view must have the dimensions and number of planes of layoutDescriptor(). The default implementation decodes
+    /// into a newly allocated image, then copies it.
+    virtual void readIntof(ImageViewf image) { checkOutput(image) = readf(); }
+
+    /// Read and decode the opened stream by bands of at most bandHeight rows, passing each band in order to the
+    /// callback as soon as it is decoded. The default implementation decodes the whole image first.
+    virtual void readRows8u(int bandHeight, const RowCallback<uint8_t> &callback) {
+        forEachBand(read8u(), bandHeight, callback);
+    }
+
+    /// Read and decode the opened stream by bands of at most bandHeight rows, passing each band in order to the
+    /// callback as soon as it is decoded. The default implementation decodes the whole image first.
+    virtual void readRows16u(int bandHeight, const RowCallback<uint16_t> &callback) {
+        forEachBand(read16u(), bandHeight, callback);
+    }
+
+    /// Read and decode the opened stream by bands of at most bandHeight rows, passing each band in order to the
+    /// callback as soon as it is decoded. The default implementation decodes the whole image first.
+    virtual void readRowsf(int bandHeight, const RowCallback<float> &callback) {
+        forEachBand(readf(), bandHeight, callback);
+    }
+
     /// Read the image EXIF metadata, if available.
     virtual std::optional<ExifMetadata> readExif() const { return std::nullopt; }
 
@@ -122,6 +210,46 @@ protected:
     const std::string& path() const { return mPath; }
     const Options& options() const { return mOptions; }
 
+    /// Returns whether the stream has been opened from the path by the reader itself.
+    bool ownsStream() const noexcept { return mOwnStream != nullptr; }
+
+    /// Throws if the given output view does not have the dimensions and number of planes of the image.
+    template <typename T>
+    ImageView<T>& checkOutput(ImageView<T>& image) const {
+        const LayoutDescriptor layout = layoutDescriptor();
+        if (image.width() != layout.width || image.height() != layout.height || image.numPlanes() != layout.numPlanes) {
+            throw IOError("Output view does not match the image dimensions.");
+        }
+        return image;
+    }
+
+    /// Throws if the given region is empty or not contained in the image.
+    const Rect& checkRegion(const Rect& region) const {
+        const LayoutDescriptor layout = layoutDescriptor();
+        if (region.width <= 0 || region.height <= 0 || region.x < 0 || region.y < 0 ||
+            region.x + region.width > layout.width || region.y + region.height > layout.height) {
+            throw IOError("Region is out of image bounds.");
+        }
+        return region;
+    }
+
+    /// Throws if the given band height is not positive.
+    static int checkBandHeight(int bandHeight) {
+        if (bandHeight <= 0) {
+            throw IOError("Band height must be positive.");
+        }
+        return bandHeight;
+    }
+
+    /// Passes the given image to the callback by bands of at most bandHeight rows.
+    template <typename T>
+    static void forEachBand(const Image<T> &image, int bandHeight, const RowCallback<T> &callback) {
+        checkBandHeight(bandHeight);
+        for (int y = 0; y < image.height(); y += bandHeight) {
+            callback(y, image[Rect{0, y, image.width(), std::min(bandHeight, image.height() - y)}]);
+        }
+    }
+
     template <typename T>
     void validateType() const {
         using namespace std::string_literals;
@@ -155,4 +283,57 @@ private:
     std::unique_ptr<std::istream> mOwnStream;
 };
 
+/// Input iterator over the frames of an image reader.
+/// @ingroup io
+template <typename T>
+class FrameIterator final {
+public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = Image<T>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = Image<T>;
+
+    FrameIterator(ImageReader* reader, int index) : mReader(reader), mIndex(index) {}
+
+    /// Selects and decodes the current frame.
+    Image<T> operator*() const {
+        mReader->selectFrame(mIndex);
+
+        if constexpr (std::is_same_v<T, uint8_t>) {
+            return mReader->read8u();
+        } else if constexpr (std::is_same_v<T, uint16_t>) {
+            return mReader->read16u();
+        } else {
+            return mReader->readf();
+        }
+    }
+
+    FrameIterator& operator++() {
+        ++mIndex;
+        return *this;
+    }
+
+    bool operator==(const FrameIterator& other) const { return mIndex == other.mIndex; }
+    bool operator!=(const FrameIterator& other) const { return mIndex != other.mIndex; }
+
+private:
+    ImageReader* mReader;
+    int mIndex;
+};
+
+/// Range of the frames of an image reader.
+/// @ingroup io
+template <typename T>
+class FrameRange final {
+public:
+    explicit FrameRange(ImageReader* reader) : mReader(reader) {}
+
+    FrameIterator<T> begin() const { return {mReader, 0}; }
+    FrameIterator<T> end() const { return {mReader, mReader->numFrames()}; }
+
+private:
+    ImageReader* mReader;
+};
+
 } // namespace cxximg
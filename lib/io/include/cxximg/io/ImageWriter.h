@@ -17,10 +17,13 @@
 #include "cxximg/io/Exceptions.h"
 
 #include "cxximg/image/Image.h"
+#include "cxximg/math/Rect.h"
 #include "cxximg/model/ExifMetadata.h"
 #include "cxximg/model/ImageMetadata.h"
 
+#include <algorithm>
 #include <fstream>
+#include <functional>
 #include <optional>
 #include <string>
 
@@ -30,7 +33,18 @@ namespace cxximg {
 /// @ingroup io
 class ImageWriter {
 public:
-    enum class TiffCompression { NONE, DEFLATE };
+    enum class TiffCompression { NONE, DEFLATE, LZW, ZSTD };
+
+    /// DNG raw data compression. Lossless uses lossless JPEG for integer data and deflate for floating point data.
+    enum class DngCompression { NONE, LOSSLESS };
+
+    /// PNG filtering and deflate settings. Fast uses a fixed filter and the fastest compression level, auto compresses
+    /// a few rows to choose the filter and strategy matching the image content, at the given compression level.
+    enum class PngProfile { DEFAULT, FAST, AUTO };
+
+    /// CXI pixel data compression. Bayer is a lossless predictive coding of 16 bits Bayer and quad Bayer images, smaller
+    /// but slower than zstd level 1 on raw sensor data. Compressed images cannot be memory mapped when read.
+    enum class CxiCompression { NONE, ZSTD, BAYER };
 
     struct Options {
         std::optional<FileFormat> fileFormat;
@@ -38,7 +52,17 @@ public:
 
         int jpegQuality = 95; // in [1-100]
         TiffCompression tiffCompression = TiffCompression::DEFLATE;
-        int compressionLevel = 4; // in [1-9]
+        DngCompression dngCompression = DngCompression::LOSSLESS;
+        PngProfile pngProfile = PngProfile::DEFAULT;
+        CxiCompression cxiCompression = CxiCompression::NONE;
+        int compressionLevel = 4;  // in [1-9]
+        int tiffTileSize = 0;      // TIFF tile width and height, multiple of 16, 0 to write strips
+        int tiffRowsPerStrip = 0;  // 0 to let libtiff choose
+        bool tiffBigTiff = false;  // always write BigTIFF, otherwise only used when the image exceeds 4 GB
+        int tiffPyramidLevels = 0; // number of 2x reduced resolution TIFF subfiles written after the image
+        int numThreads = 1;        // 0 means all available cores
+        bool jxlStreaming = false; // encode JPEG XL by row bands and stream the output (libjxl 0.10+), bounding memory
+        bool pngParallel = false;  // filter and deflate PNG row bands on numThreads threads
 
         Options() = default;
 
@@ -56,22 +80,59 @@ public:
         if (tiffCompression == "deflate") {
             return TiffCompression::DEFLATE;
         }
+        if (tiffCompression == "lzw") {
+            return TiffCompression::LZW;
+        }
+        if (tiffCompression == "zstd") {
+            return TiffCompression::ZSTD;
+        }
         return std::nullopt;
     }
 
-    /// Constructs with stream and options.
-    ImageWriter(std::string path, std::ostream *stream, Options options)
-        : mStream(stream), mPath(std::move(path)), mOptions(std::move(options)) {
-        if (!stream) {
-            mOwnStream = std::make_unique<std::ofstream>(mPath, std::ios::binary);
-            mStream = mOwnStream.get();
+    static std::optional<DngCompression> parseDngCompression(const std::string &dngCompression) {
+        if (dngCompression == "none") {
+            return DngCompression::NONE;
+        }
+        if (dngCompression == "lossless") {
+            return DngCompression::LOSSLESS;
+        }
+        return std::nullopt;
+    }
 
-            if (!*mStream) {
-                throw IOError("Cannot open file for writing: " + mPath);
-            }
+    static std::optional<PngProfile> parsePngProfile(const std::string &pngProfile) {
+        if (pngProfile == "default") {
+            return PngProfile::DEFAULT;
         }
+        if (pngProfile == "fast") {
+            return PngProfile::FAST;
+        }
+        if (pngProfile == "auto") {
+            return PngProfile::AUTO;
+        }
+        return std::nullopt;
+    }
+
+    static std::optional<CxiCompression> parseCxiCompression(const std::string &cxiCompression) {
+        if (cxiCompression == "none") {
+            return CxiCompression::NONE;
+        }
+        if (cxiCompression == "zstd") {
+            return CxiCompression::ZSTD;
+        }
+        if (cxiCompression == "bayer") {
+            return CxiCompression::BAYER;
+        }
+        return std::nullopt;
     }
 
+    /// Callback filling the rows [y, y + rows.height()) of the image to write.
+    template <typename T>
+    using RowSource = std::function<void(int y, ImageView<T> &rows)>;
+
+    /// Constructs with stream and options. Without stream, the file is opened when first written.
+    ImageWriter(std::string path, std::ostream *stream, Options options)
+        : mPath(std::move(path)), mOptions(std::move(options)), mStream(stream) {}
+
     /// Destructor.
     virtual ~ImageWriter() = default;
 
@@ -93,6 +154,27 @@ public:
         throw IOError("This format does not support float write.");
     }
 
+    /// Encode and write an image with the given layout by bands of at most bandHeight rows, each band being filled in
+    /// order by the source just before being encoded. The bands may have a different image layout than the given one.
+    /// The default implementation fills the whole image first.
+    virtual void writeRows8u(const LayoutDescriptor &layout, int bandHeight, const RowSource<uint8_t> &source) const {
+        write(fillBands(layout, bandHeight, source));
+    }
+
+    /// Encode and write an image with the given layout by bands of at most bandHeight rows, each band being filled in
+    /// order by the source just before being encoded. The bands may have a different image layout than the given one.
+    /// The default implementation fills the whole image first.
+    virtual void writeRows16u(const LayoutDescriptor &layout, int bandHeight, const RowSource<uint16_t> &source) const {
+        write(fillBands(layout, bandHeight, source));
+    }
+
+    /// Encode and write an image with the given layout by bands of at most bandHeight rows, each band being filled in
+    /// order by the source just before being encoded. The bands may have a different image layout than the given one.
+    /// The default implementation fills the whole image first.
+    virtual void writeRowsf(const LayoutDescriptor &layout, int bandHeight, const RowSource<float> &source) const {
+        write(fillBands(layout, bandHeight, source));
+    }
+
     /// Write the given EXIF metadata into the opened stream.
     virtual void writeExif([[maybe_unused]] const ExifMetadata &exif) const {
         throw IOError("This format does not support EXIF write.");
@@ -108,13 +190,60 @@ protected:
     const std::string &path() const { return mPath; }
     const Options &options() const { return mOptions; }
 
-    std::ostream *mStream;
+    /// Throws if the given band height is not positive.
+    static int checkBandHeight(int bandHeight) {
+        if (bandHeight <= 0) {
+            throw IOError("Band height must be positive.");
+        }
+        return bandHeight;
+    }
+
+    /// Allocates an image with the given layout, then fills it with the source by bands of at most bandHeight rows.
+    template <typename T>
+    static Image<T> fillBands(const LayoutDescriptor &layout, int bandHeight, const RowSource<T> &source) {
+        checkBandHeight(bandHeight);
+
+        Image<T> image(layout);
+        for (int y = 0; y < image.height(); y += bandHeight) {
+            ImageView<T> rows = image[Rect{0, y, image.width(), std::min(bandHeight, image.height() - y)}];
+            source(y, rows);
+        }
+        return image;
+    }
+
+    /// Returns whether the file is opened from the path by the writer itself, no stream having been given.
+    bool ownsStream() const noexcept { return !mStream || mOwnStream != nullptr; }
+
+    /// Returns the output stream, opening the file with the given mode on first call if no stream was given.
+    /// Opening lazily allows to update an existing file, e.g. with writeExif(), without truncating it.
+    std::ostream *stream(std::ios::openmode mode = std::ios::out) const {
+        if (!mStream) {
+            auto ownStream = std::make_unique<std::fstream>(mPath, mode | std::ios::binary);
+            if (!*ownStream) {
+                throw IOError("Cannot open file for writing: " + mPath);
+            }
+
+            mOwnStream = std::move(ownStream);
+            mStream = mOwnStream.get();
+        }
+        return mStream;
+    }
+
+    /// Closes the file opened from the path, flushing pending writes, so that the next call to stream() reopens it.
+    /// Used when the file is replaced on disk. Does nothing if the stream has been given.
+    void closeStream() const {
+        if (mOwnStream) {
+            mOwnStream.reset();
+            mStream = nullptr;
+        }
+    }
 
 private:
     std::string mPath;
     Options mOptions;
 
-    std::unique_ptr<std::ostream> mOwnStream;
+    mutable std::ostream *mStream;
+    mutable std::unique_ptr<std::ostream> mOwnStream;
 };
 
 } // namespace cxximg
@@ -0,0 +1,187 @@
+// Copyright 2023-2025 Emmanuel Chaboud
+//
+/// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cxximg/io/ImageIO.h"
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace cxximg {
+
+namespace io {
+
+namespace {
+
+/// Bounds the total size of the decoded images in flight.
+class MemoryBudget final {
+public:
+    explicit MemoryBudget(int64_t budget) : mBudget(budget) {}
+
+    /// Waits until the given size fits in the budget, or nothing else is in flight. Returns false if cancelled.
+    bool acquire(int64_t size) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCondition.wait(lock, [&]() { return mCancelled || mBudget <= 0 || mUsed == 0 || mUsed + size <= mBudget; });
+        mUsed += size;
+        return !mCancelled;
+    }
+
+    void release(int64_t size) {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mUsed -= size;
+        }
+        mCondition.notify_all();
+    }
+
+    /// Wakes up and fails all the pending and future acquisitions.
+    void cancel() {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mCancelled = true;
+        }
+        mCondition.notify_all();
+    }
+
+private:
+    int64_t mBudget;
+    int64_t mUsed = 0;
+    bool mCancelled = false;
+
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+};
+
+/// Returns the size in bytes of the image that the reader will decode.
+int64_t decodedSize(const ImageReader &reader) {
+    const int64_t bufferSize = reader.layoutDescriptor().requiredBufferSize();
+    switch (reader.pixelRepresentation()) {
+        case PixelRepresentation::UINT8:
+            return bufferSize * sizeof(uint8_t);
+        case PixelRepresentation::UINT16:
+            return bufferSize * sizeof(uint16_t);
+        case PixelRepresentation::FLOAT:
+            return bufferSize * sizeof(float);
+    }
+    return bufferSize;
+}
+
+/// Decodes the given file, once its decoded size fits in the memory budget. Returns false if cancelled.
+bool decode(BatchImage &result, int64_t &size, const BatchOptions &options, MemoryBudget &budget) {
+    try {
+        std::unique_ptr<ImageReader> reader = makeReader(result.path, options.readOptions);
+
+        size = decodedSize(*reader);
+        if (!budget.acquire(size)) {
+            return false;
+        }
+
+        reader->readMetadata(result.metadata);
+
+        switch (reader->pixelRepresentation()) {
+            case PixelRepresentation::UINT8:
+                result.image = reader->read8u();
+                break;
+            case PixelRepresentation::UINT16:
+                result.image = reader->read16u();
+                break;
+            case PixelRepresentation::FLOAT:
+                result.image = reader->readf();
+                break;
+        }
+    } catch (...) {
+        result.image = std::monostate{};
+        result.error = std::current_exception();
+    }
+
+    return true;
+}
+
+} // namespace
+
+void decodeBatch(const std::vector<std::string> &paths,
+                 const std::function<void(BatchImage &&)> &callback,
+                 const BatchOptions &options) {
+    const int count = static_cast<int>(paths.size());
+    const int numThreads = std::min(detail::resolveNumThreads(options.numThreads), count);
+
+    MemoryBudget budget(options.memoryBudget);
+
+    std::atomic<int> next = 0;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    std::deque<std::pair<BatchImage, int64_t>> queue;
+
+    const auto worker = [&]() {
+        for (int i = next++; i < count; i = next++) {
+            BatchImage result;
+            result.path = paths[i];
+            int64_t size = 0;
+
+            if (!decode(result, size, options, budget)) {
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                queue.emplace_back(std::move(result), size);
+            }
+            queueCondition.notify_one();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(numThreads);
+    for (int i = 0; i < numThreads; ++i) {
+        threads.emplace_back(worker);
+    }
+
+    const auto joinThreads = [&]() {
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    };
+
+    try {
+        for (int delivered = 0; delivered < count; ++delivered) {
+            std::pair<BatchImage, int64_t> item;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueCondition.wait(lock, [&]() { return !queue.empty(); });
+                item = std::move(queue.front());
+                queue.pop_front();
+            }
+
+            callback(std::move(item.first));
+            budget.release(item.second);
+        }
+    } catch (...) {
+        // Stop the workers before the shared state goes out of scope
+        next = count;
+        budget.cancel();
+        joinThreads();
+        throw;
+    }
+
+    joinThreads();
+}
+
+} // namespace io
+
+} // namespace cxximg
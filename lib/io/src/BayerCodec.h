@@ -0,0 +1,313 @@
+// Copyright 2023-2025 Emmanuel Chaboud
+//
+/// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "cxximg/model/PixelType.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+namespace cxximg {
+
+namespace detail {
+
+/// Lossless predictive codec for 16 bits Bayer and quad Bayer samples.
+///
+/// Each sample is predicted from its nearest left and upper neighbours of the same color with the median edge detector of
+/// LOCO-I. The residuals are Rice coded, with a parameter adapted to the color and the local gradient. Samples are coded
+/// by bands of rows, each band being independent so that bands can be encoded and decoded in parallel.
+class BayerCodec final {
+public:
+    /// Constructs for a buffer of the given pixel type, whose rows are rowStride samples long, the first image sample
+    /// being at the given offset.
+    BayerCodec(PixelType pixelType, int64_t offset, int64_t rowStride)
+        : mOriginX(static_cast<int>(offset % rowStride)),
+          mOriginY(static_cast<int>(offset / rowStride)),
+          mRowStride(rowStride) {
+        // Quad Bayer 2x2 cells of the same color follow a Bayer pattern
+        const bool quad = model::isQuadBayerPixelType(pixelType);
+        mCellShift = quad ? 1 : 0;
+
+        for (int i = 0; i < 4; ++i) {
+            // Distance to the previous sample of the same color, in the 2x2 block or in the previous block
+            mDistance[i] = quad ? ((i & 1) ? 1 : 3) : 2;
+        }
+    }
+
+    /// Encodes numSamples samples starting at the first sample of the given buffer row, the last row being possibly
+    /// incomplete.
+    std::vector<uint8_t> encode(const uint16_t *samples, int64_t firstRow, int64_t numSamples) const {
+        BitWriter writer(numSamples);
+        Contexts contexts;
+
+        forEachSample(samples, firstRow, numSamples, [&](const uint16_t *sample, int prediction, int context) {
+            const uint16_t residual = *sample - prediction;
+            const uint32_t value = static_cast<uint16_t>((residual << 1) ^ (-(residual >> 15)));
+
+            Context &ctx = contexts[context];
+            const int k = ctx.parameter();
+            const int quotient = static_cast<int>(value >> k);
+
+            if (quotient < ESCAPE) {
+                writer.put(1, quotient + 1);
+                writer.put(value & ((1 << k) - 1), k);
+            } else {
+                writer.put(1, ESCAPE + 1);
+                writer.put(value, 16);
+            }
+
+            ctx.update(value);
+        });
+
+        return writer.finish();
+    }
+
+    /// Decodes numSamples samples starting at the first sample of the given buffer row. Returns false if the data is
+    /// corrupted.
+    bool decode(const uint8_t *data, size_t size, uint16_t *samples, int64_t firstRow, int64_t numSamples) const {
+        BitReader reader(data, size);
+        Contexts contexts;
+        bool valid = true;
+
+        forEachSample(samples, firstRow, numSamples, [&](uint16_t *sample, int prediction, int context) {
+            Context &ctx = contexts[context];
+            const int k = ctx.parameter();
+
+            reader.refill();
+            const int quotient = reader.unary();
+
+            uint32_t value = 0;
+            if (quotient < ESCAPE) {
+                value = (quotient << k) | reader.get(k);
+            } else if (quotient == ESCAPE) {
+                value = reader.get(16);
+            } else {
+                valid = false;
+            }
+
+            // Value is at most 16 bits, the zigzag mapping is inverted in 16 bits arithmetic
+            *sample = static_cast<uint16_t>(prediction + ((value >> 1) ^ (0U - (value & 1))));
+
+            ctx.update(value);
+        });
+
+        return valid && !reader.overrun();
+    }
+
+private:
+    // Quotients from this value on are escaped, the value being stored in binary
+    static constexpr int ESCAPE = 24;
+
+    // Contexts: 4 colors times 9 gradient classes
+    static constexpr int NUM_GRADIENTS = 9;
+
+    // Running mean of the coded values, over about the last 16 values
+    struct Context final {
+        uint32_t sum = 16 * 16;
+
+        int parameter() const noexcept { return bitLength(sum >> 4); }
+
+        void update(uint32_t value) noexcept { sum += value - (sum >> 4); }
+    };
+
+    using Contexts = Context[4 * NUM_GRADIENTS];
+
+    class BitWriter final {
+    public:
+        explicit BitWriter(int64_t numSamples) : mData(numSamples * 2 + 8) {}
+
+        void put(uint32_t value, int numBits) {
+            mBuffer = (mBuffer << numBits) | value;
+            mNumBits += numBits;
+            if (mNumBits >= 32) {
+                mNumBits -= 32;
+                if (mSize + 4 > mData.size()) {
+                    mData.resize(2 * mData.size());
+                }
+
+                const auto word = static_cast<uint32_t>(mBuffer >> mNumBits);
+                mData[mSize++] = word >> 24;
+                mData[mSize++] = word >> 16;
+                mData[mSize++] = word >> 8;
+                mData[mSize++] = word;
+            }
+        }
+
+        std::vector<uint8_t> finish() {
+            mData.resize(mSize);
+            while (mNumBits > 0) {
+                const int shift = mNumBits - 8;
+                mData.push_back(shift >= 0 ? mBuffer >> shift : mBuffer << -shift);
+                mNumBits -= 8;
+            }
+            return std::move(mData);
+        }
+
+    private:
+        std::vector<uint8_t> mData;
+        size_t mSize = 0;
+        uint64_t mBuffer = 0;
+        int mNumBits = 0;
+    };
+
+    class BitReader final {
+    public:
+        BitReader(const uint8_t *data, size_t size) : mData(data), mEnd(data + size) {}
+
+        // Ensures that at least 57 bits are buffered, reading zeros past the end of the data
+        void refill() {
+            if (mEnd - mData >= 8) {
+                // Bits past the consumed bytes are loaded again by the next refill, at the same position
+                uint64_t word = 0;
+                for (int i = 0; i < 8; ++i) {
+                    word = (word << 8) | mData[i];
+                }
+                mBuffer |= word >> mNumBits;
+
+                const int numBytes = (63 - mNumBits) >> 3;
+                mData += numBytes;
+                mNumBits += 8 * numBytes;
+                return;
+            }
+
+            while (mNumBits <= 56) {
+                if (mData < mEnd) {
+                    mBuffer |= static_cast<uint64_t>(*mData++) << (56 - mNumBits);
+                } else {
+                    mPadding += 8;
+                }
+                mNumBits += 8;
+            }
+        }
+
+        uint32_t get(int numBits) {
+            if (numBits == 0) {
+                return 0;
+            }
+            const auto value = static_cast<uint32_t>(mBuffer >> (64 - numBits));
+            mBuffer <<= numBits;
+            mNumBits -= numBits;
+            return value;
+        }
+
+        // Reads zeros up to the next one, returns ESCAPE + 1 if there are too many
+        int unary() {
+            const int numZeros = countLeadingZeros(mBuffer);
+            if (numZeros > ESCAPE) {
+                return ESCAPE + 1;
+            }
+            get(numZeros + 1);
+            return numZeros;
+        }
+
+        bool overrun() const noexcept { return mPadding > mNumBits; }
+
+    private:
+        const uint8_t *mData;
+        const uint8_t *mEnd;
+        uint64_t mBuffer = 0;
+        int mNumBits = 0;
+        int mPadding = 0; // number of buffered bits read past the end
+    };
+
+    static int bitLength(uint32_t value) { return 64 - countLeadingZeros(value); }
+
+    static int countLeadingZeros(uint64_t value) {
+        if (value == 0) {
+            return 64;
+        }
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_clzll(value);
+#else
+        int n = 0;
+        while ((value & (uint64_t(1) << 63)) == 0) {
+            value <<= 1;
+            ++n;
+        }
+        return n;
+#endif
+    }
+
+    // Median edge detector, written as the median of a, b and a + b - c to avoid branches on noisy data
+    static int predict(int a, int b, int c) { return std::max(std::min(a, b), std::min(std::max(a, b), a + b - c)); }
+
+    // Calls function(sample, prediction, context) for each sample in order, the previous samples being already coded
+    template <typename Sample, typename Function>
+    void forEachSample(Sample *samples, int64_t firstRow, int64_t numSamples, Function &&function) const {
+        for (int64_t row = 0; row * mRowStride < numSamples; ++row) {
+            Sample *current = samples + row * mRowStride;
+            const int64_t width = std::min(mRowStride, numSamples - row * mRowStride);
+
+            const int iy = static_cast<int>(firstRow + row) - mOriginY;
+            const int up = mDistance[iy & 3];
+            const Sample *above = row >= up ? current - up * mRowStride : nullptr;
+            const int rowColor = ((iy >> mCellShift) & 1) << 1;
+
+            const auto context = [&](int ix, int gradient) {
+                const int color = rowColor | ((ix >> mCellShift) & 1);
+                return color * NUM_GRADIENTS + std::min(bitLength(gradient) >> 1, NUM_GRADIENTS - 1);
+            };
+
+            // First samples of the row, without left neighbour
+            const int64_t start = std::min<int64_t>(width, 3);
+            for (int64_t x = 0; x < start; ++x) {
+                const int ix = static_cast<int>(x) - mOriginX;
+                const int left = mDistance[ix & 3];
+
+                int prediction = 0;
+                int gradient = 0;
+                if (x >= left && above) {
+                    prediction = predict(current[x - left], above[x], above[x - left]);
+                    gradient = std::abs(current[x - left] - above[x - left]) + std::abs(above[x] - above[x - left]);
+                } else if (x >= left) {
+                    prediction = current[x - left];
+                } else if (above) {
+                    prediction = above[x];
+                }
+                function(current + x, prediction, context(ix, gradient));
+            }
+
+            if (!above) {
+                for (int64_t x = start; x < width; ++x) {
+                    const int ix = static_cast<int>(x) - mOriginX;
+                    function(current + x, current[x - mDistance[ix & 3]], context(ix, 0));
+                }
+                continue;
+            }
+
+            for (int64_t x = start; x < width; ++x) {
+                const int ix = static_cast<int>(x) - mOriginX;
+                const int left = mDistance[ix & 3];
+
+                const int a = current[x - left];
+                const int b = above[x];
+                const int c = above[x - left];
+                function(current + x, predict(a, b, c), context(ix, std::abs(a - c) + std::abs(b - c)));
+            }
+        }
+    }
+
+    int mOriginX;
+    int mOriginY;
+    int64_t mRowStride;
+    int mCellShift = 0;
+    int mDistance[4] = {};
+};
+
+} // namespace detail
+
+} // namespace cxximg
@@ -0,0 +1,815 @@
+// Copyright 2023-2025 Emmanuel Chaboud
+//
+/// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "CxiIO.h"
+#include "BayerCodec.h"
+#include "MappedInput.h"
+#include "Parallel.h"
+
+#include <loguru.hpp>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <type_traits>
+#include <unordered_map>
+#include <variant>
+
+using namespace std::string_literals;
+
+namespace cxximg {
+
+static const std::string MODULE = "CXI";
+
+namespace {
+
+constexpr uint32_t VERSION = 1;
+constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+// Pixel data starts on a page boundary, so that uncompressed images can be memory mapped
+constexpr int64_t DATA_ALIGNMENT = 4096;
+
+// Compressed planes are split into chunks of at most this size, compressed and decompressed in parallel
+constexpr int64_t CHUNK_SIZE = 4 << 20;
+
+// Bayer compressed images are split into bands of rows of about this size, each band being coded independently
+constexpr int64_t BAND_SIZE = 1 << 20;
+
+constexpr int64_t MAX_METADATA_SIZE = 1 << 30;
+
+struct PlaneHeader final {
+    int32_t index;
+    int32_t subsample;
+    int64_t offset;
+    int64_t rowStride;
+    int64_t pixelStride;
+};
+
+// Fixed size header, followed by the chunk table, the metadata, then the pixel data. All values are in native byte
+// order, which is checked with the byte order mark.
+struct FileHeader final {
+    uint8_t signature[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    int32_t pixelRepresentation;
+    int32_t compression;
+    int32_t imageLayout;
+    int32_t pixelType;
+    int32_t pixelPrecision;
+    int32_t width;
+    int32_t height;
+    int32_t numPlanes;
+    int32_t widthAlignment;
+    int32_t heightAlignment;
+    int32_t sizeAlignment;
+    int32_t border;
+    PlaneHeader planes[image::detail::MAX_NUM_PLANES];
+    int64_t bufferSize; // in bytes
+    int64_t numChunks;
+    int64_t metadataSize; // in bytes, 0 when the image has no metadata
+};
+
+static_assert(sizeof(FileHeader) == 216 && std::is_trivially_copyable_v<FileHeader>);
+static_assert(sizeof(detail::CxiChunk) == 32 && std::is_trivially_copyable_v<detail::CxiChunk>);
+
+int64_t pixelSize(PixelRepresentation pixelRepresentation) {
+    switch (pixelRepresentation) {
+        case PixelRepresentation::UINT8:
+            return sizeof(uint8_t);
+        case PixelRepresentation::UINT16:
+            return sizeof(uint16_t);
+        case PixelRepresentation::FLOAT:
+            return sizeof(float);
+    }
+    throw IOError(MODULE, "Invalid pixel representation");
+}
+
+template <typename T>
+PixelRepresentation pixelRepresentation() {
+    if constexpr (std::is_same_v<T, uint8_t>) {
+        return PixelRepresentation::UINT8;
+    } else if constexpr (std::is_same_v<T, uint16_t>) {
+        return PixelRepresentation::UINT16;
+    } else {
+        return PixelRepresentation::FLOAT;
+    }
+}
+
+bool samePlanes(const LayoutDescriptor &a, const LayoutDescriptor &b) {
+    for (int i = 0; i < a.numPlanes; ++i) {
+        const PlaneDescriptor &pa = a.planes[i];
+        const PlaneDescriptor &pb = b.planes[i];
+        if (pa.index != pb.index || pa.subsample != pb.subsample || pa.offset != pb.offset ||
+            pa.rowStride != pb.rowStride || pa.pixelStride != pb.pixelStride) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Splits the image buffer into chunks of at most CHUNK_SIZE bytes, so that a chunk does not span several planes.
+std::vector<detail::CxiChunk> splitChunks(const LayoutDescriptor &layout, int64_t bufferSize, int64_t pixelSize) {
+    // Interleaved planes share their rows, planes are only split where their rows start
+    std::vector<int64_t> boundaries = {0, bufferSize};
+    for (int i = 0; i < layout.numPlanes; ++i) {
+        const PlaneDescriptor &plane = layout.planes[i];
+        if (plane.pixelStride == 1 && plane.rowStride > 0) {
+            boundaries.push_back(plane.offset / plane.rowStride * plane.rowStride * pixelSize);
+        }
+    }
+
+    std::sort(boundaries.begin(), boundaries.end());
+    boundaries.erase(std::unique(boundaries.begin(), boundaries.end()), boundaries.end());
+
+    std::vector<detail::CxiChunk> chunks;
+    for (size_t i = 1; i < boundaries.size(); ++i) {
+        for (int64_t offset = boundaries[i - 1]; offset < boundaries[i]; offset += CHUNK_SIZE) {
+            const int64_t size = std::min(CHUNK_SIZE, boundaries[i] - offset);
+            chunks.push_back({offset, size, 0, size});
+        }
+    }
+    return chunks;
+}
+
+bool isBayerImage(PixelRepresentation pixelRepresentation, const LayoutDescriptor &layout) {
+    return pixelRepresentation == PixelRepresentation::UINT16 && layout.numPlanes == 1 &&
+           layout.planes[0].pixelStride == 1 &&
+           (model::isBayerPixelType(layout.pixelType) || model::isQuadBayerPixelType(layout.pixelType));
+}
+
+detail::BayerCodec bayerCodec(const LayoutDescriptor &layout) {
+    return {layout.pixelType, layout.planes[0].offset, layout.planes[0].rowStride};
+}
+
+// Splits the image buffer into bands of whole rows, of more than BAND_SIZE / 2 bytes except for the last one.
+std::vector<detail::CxiChunk> splitBands(const LayoutDescriptor &layout, int64_t bufferSize) {
+    const int64_t rowSize = layout.planes[0].rowStride * sizeof(uint16_t);
+    const int64_t bandSize = std::max<int64_t>(BAND_SIZE / rowSize, 1) * rowSize;
+
+    std::vector<detail::CxiChunk> chunks;
+    for (int64_t offset = 0; offset < bufferSize; offset += bandSize) {
+        const int64_t size = std::min(bandSize, bufferSize - offset);
+        chunks.push_back({offset, size, 0, size});
+    }
+    return chunks;
+}
+
+// Metadata is serialized field by field, optional values being preceded by a presence flag and containers by their
+// number of elements.
+
+template <typename Archive>
+void serialize(Archive &archive, ExifMetadata::Rational &value) {
+    archive(value.numerator, value.denominator);
+}
+
+template <typename Archive>
+void serialize(Archive &archive, ExifMetadata::SRational &value) {
+    archive(value.numerator, value.denominator);
+}
+
+template <typename Archive>
+void serialize(Archive &archive, ExifMetadata &value) {
+    archive(value.imageWidth,
+            value.imageHeight,
+            value.imageDescription,
+            value.make,
+            value.model,
+            value.orientation,
+            value.software,
+            value.exposureTime,
+            value.fNumber,
+            value.isoSpeedRatings,
+            value.dateTimeOriginal,
+            value.brightnessValue,
+            value.exposureBiasValue,
+            value.focalLength,
+            value.focalLengthIn35mmFilm,
+            value.lensMake,
+            value.lensModel);
+}
+
+template <typename Archive>
+void serialize(Archive &archive, Rectf &value) {
+    archive(value.x, value.y, value.width, value.height);
+}
+
+template <typename Archive>
+void serialize(Archive &archive, ImageMetadata::ColorShading &value) {
+    archive(value.gainR, value.gainB);
+}
+
+template <typename Archive>
+void serialize(Archive &archive, ImageMetadata::WhiteBalance &value) {
+    archive(value.gainR, value.gainB);
+}
+
+template <typename Archive>
+void serialize(Archive &archive, ImageMetadata::SemanticMask &value) {
+    archive(value.name, value.label, value.mask);
+}
+
+template <typename Archive>
+void serialize(Archive &archive, ImageMetadata::FileInfo &value) {
+    archive(value.fileFormat,
+            value.pixelRepresentation,
+            value.imageLayout,
+            value.pixelType,
+            value.pixelPrecision,
+            value.width,
+            value.height,
+            value.widthAlignment,
+            value.heightAlignment,
+            value.sizeAlignment);
+}
+
+template <typename Archive>
+void serialize(Archive &archive, ImageMetadata::CameraControls &value) {
+    archive(value.whiteBalance, value.colorShading, value.faceDetection);
+}
+
+template <typename Archive>
+void serialize(Archive &archive, ImageMetadata::ShootingParams &value) {
+    archive(value.aperture,
+            value.exposureTime,
+            value.sensitivity,
+            value.totalGain,
+            value.sensorGain,
+            value.ispGain,
+            value.zoom);
+}
+
+template <typename Archive>
+void serialize(Archive &archive, ImageMetadata::CalibrationData &value) {
+    archive(value.blackLevel, value.whiteLevel, value.vignetting, value.colorMatrix, value.colorMatrixTarget);
+}
+
+template <typename Archive>
+void serialize(Archive &archive, ImageMetadata &value) {
+    archive(value.fileInfo,
+            value.exifMetadata,
+            value.shootingParams,
+            value.calibrationData,
+            value.cameraControls,
+            value.semanticMasks);
+}
+
+class MetadataWriter final {
+public:
+    const std::vector<uint8_t> &data() const noexcept { return mData; }
+
+    template <typename... Values>
+    void operator()(const Values &...values) {
+        (write(values), ...);
+    }
+
+private:
+    void writeBytes(const void *data, size_t size) {
+        const auto *bytes = static_cast<const uint8_t *>(data);
+        mData.insert(mData.end(), bytes, bytes + size);
+    }
+
+    template <typename T>
+    void write(const T &value) {
+        if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>) {
+            writeBytes(&value, sizeof(T));
+        } else {
+            serialize(*this, const_cast<T &>(value));
+        }
+    }
+
+    void write(const std::string &value) {
+        write(static_cast<uint32_t>(value.size()));
+        writeBytes(value.data(), value.size());
+    }
+
+    template <typename T>
+    void write(const std::optional<T> &value) {
+        write(value.has_value());
+        if (value) {
+            write(*value);
+        }
+    }
+
+    template <typename T>
+    void write(const std::vector<T> &values) {
+        write(static_cast<uint32_t>(values.size()));
+        for (const T &value : values) {
+            write(value);
+        }
+    }
+
+    template <typename K, typename V>
+    void write(const std::unordered_multimap<K, V> &values) {
+        write(static_cast<uint32_t>(values.size()));
+        for (const auto &[key, value] : values) {
+            write(key);
+            write(value);
+        }
+    }
+
+    void write(const std::variant<int, float> &value) {
+        write(static_cast<uint8_t>(value.index()));
+        std::visit([this](auto v) { write(v); }, value);
+    }
+
+    void write(const DynamicMatrix &value) {
+        write(static_cast<int32_t>(value.numRows()));
+        write(static_cast<int32_t>(value.numCols()));
+        writeBytes(value.data(), sizeof(float) * value.numRows() * value.numCols());
+    }
+
+    template <int M, int N>
+    void write(const Matrix<M, N> &value) {
+        writeBytes(value.data(), sizeof(float) * M * N);
+    }
+
+    std::vector<uint8_t> mData;
+};
+
+class MetadataReader final {
+public:
+    MetadataReader(const uint8_t *data, size_t size) : mData(data), mEnd(data + size) {}
+
+    template <typename... Values>
+    void operator()(Values &...values) {
+        (read(values), ...);
+    }
+
+private:
+    size_t remaining() const noexcept { return mEnd - mData; }
+
+    void readBytes(void *data, size_t size) {
+        if (size > remaining()) {
+            throw IOError(MODULE, "Truncated metadata");
+        }
+        std::copy_n(mData, size, static_cast<uint8_t *>(data));
+        mData += size;
+    }
+
+    template <typename T>
+    void read(T &value) {
+        if constexpr (std::is_same_v<T, bool>) {
+            uint8_t flag = 0;
+            readBytes(&flag, 1);
+            value = flag != 0;
+        } else if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>) {
+            readBytes(&value, sizeof(T));
+        } else {
+            serialize(*this, value);
+        }
+    }
+
+    // Each element takes at least one byte, which bounds the number of elements of a valid input
+    uint32_t readCount() {
+        uint32_t count = 0;
+        read(count);
+        if (count > remaining()) {
+            throw IOError(MODULE, "Truncated metadata");
+        }
+        return count;
+    }
+
+    void read(std::string &value) {
+        const uint32_t size = readCount();
+        value.assign(reinterpret_cast<const char *>(mData), size);
+        mData += size;
+    }
+
+    template <typename T>
+    void read(std::optional<T> &value) {
+        bool present = false;
+        read(present);
+        if (present) {
+            read(value.emplace());
+        } else {
+            value.reset();
+        }
+    }
+
+    template <typename T>
+    void read(std::vector<T> &values) {
+        values.resize(readCount());
+        for (T &value : values) {
+            read(value);
+        }
+    }
+
+    template <typename K, typename V>
+    void read(std::unordered_multimap<K, V> &values) {
+        const uint32_t count = readCount();
+        values.clear();
+        for (uint32_t i = 0; i < count; ++i) {
+            K key{};
+            V value{};
+            read(key);
+            read(value);
+            values.emplace(key, std::move(value));
+        }
+    }
+
+    void read(std::variant<int, float> &value) {
+        uint8_t index = 0;
+        read(index);
+        if (index == 0) {
+            read(value.emplace<int>());
+        } else if (index == 1) {
+            read(value.emplace<float>());
+        } else {
+            throw IOError(MODULE, "Invalid metadata");
+        }
+    }
+
+    void read(DynamicMatrix &value) {
+        int32_t numRows = 0;
+        int32_t numCols = 0;
+        read(numRows);
+        read(numCols);
+        if (numRows < 0 || numCols < 0 || sizeof(float) * numRows * numCols > remaining()) {
+            throw IOError(MODULE, "Invalid metadata");
+        }
+        value = DynamicMatrix(numRows, numCols);
+        readBytes(value.data(), sizeof(float) * numRows * numCols);
+    }
+
+    template <int M, int N>
+    void read(Matrix<M, N> &value) {
+        readBytes(value.data(), sizeof(float) * M * N);
+    }
+
+    const uint8_t *mData;
+    const uint8_t *mEnd;
+};
+
+} // namespace
+
+void CxiReader::initialize() {
+    FileHeader header{};
+    mStream->read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (mStream->fail() || std::memcmp(header.signature, SIGNATURE, sizeof(SIGNATURE)) != 0) {
+        throw IOError(MODULE, "Failed to read header");
+    }
+    if (header.byteOrder != BYTE_ORDER_MARK) {
+        throw IOError(MODULE, "Unsupported byte order");
+    }
+    if (header.version > VERSION) {
+        throw IOError(MODULE, "Unsupported version: " + std::to_string(header.version));
+    }
+    if (header.compression < 0 || header.compression > static_cast<int>(ImageWriter::CxiCompression::BAYER)) {
+        throw IOError(MODULE, "Invalid compression: " + std::to_string(header.compression));
+    }
+
+    const auto pixelRepresentation = static_cast<PixelRepresentation>(header.pixelRepresentation);
+    mCompression = static_cast<ImageWriter::CxiCompression>(header.compression);
+
+    LayoutDescriptor stored = LayoutDescriptor::EMPTY;
+    stored.imageLayout = static_cast<ImageLayout>(header.imageLayout);
+    stored.pixelType = static_cast<PixelType>(header.pixelType);
+    stored.pixelPrecision = header.pixelPrecision;
+    stored.width = header.width;
+    stored.height = header.height;
+    stored.numPlanes = header.numPlanes;
+    stored.widthAlignment = header.widthAlignment;
+    stored.heightAlignment = header.heightAlignment;
+    stored.sizeAlignment = header.sizeAlignment;
+    stored.border = header.border;
+    for (int i = 0; i < image::detail::MAX_NUM_PLANES; ++i) {
+        const PlaneHeader &plane = header.planes[i];
+        stored.planes[i] = {plane.index, plane.subsample, plane.offset, plane.rowStride, plane.pixelStride};
+    }
+
+    // Images are allocated with a rebuilt layout, which must match the stored one for the pixel data to be valid
+    LayoutDescriptor layout = LayoutDescriptor::EMPTY;
+    int64_t bufferSize = 0;
+    try {
+        layout = LayoutDescriptor::Builder(stored).build();
+        bufferSize = layout.requiredBufferSize() * pixelSize(pixelRepresentation);
+    } catch (const std::invalid_argument &exception) {
+        throw IOError(MODULE, "Invalid layout: "s + exception.what());
+    }
+    if (layout.numPlanes != stored.numPlanes || !samePlanes(layout, stored) || bufferSize != header.bufferSize) {
+        throw IOError(MODULE, "Inconsistent layout");
+    }
+
+    const bool bayer = mCompression == ImageWriter::CxiCompression::BAYER;
+    if (bayer && !isBayerImage(pixelRepresentation, layout)) {
+        throw IOError(MODULE, "Bayer compression of a non Bayer image");
+    }
+
+    // Chunks must cover the whole buffer, in order, Bayer bands starting on a row
+    const int64_t minChunkSize = bayer ? BAND_SIZE / 2 : CHUNK_SIZE;
+    const int64_t maxNumChunks = (bufferSize + minChunkSize - 1) / minChunkSize + image::detail::MAX_NUM_PLANES;
+    if (header.numChunks <= 0 || header.numChunks > maxNumChunks) {
+        throw IOError(MODULE, "Invalid number of chunks: " + std::to_string(header.numChunks));
+    }
+
+    mChunks.resize(header.numChunks);
+    mStream->read(reinterpret_cast<char *>(mChunks.data()), mChunks.size() * sizeof(detail::CxiChunk));
+    if (mStream->fail()) {
+        throw IOError(MODULE, "Failed to read chunk table");
+    }
+
+    const bool compressed = mCompression != ImageWriter::CxiCompression::NONE;
+    const int64_t rowSize = layout.planes[0].rowStride * pixelSize(pixelRepresentation);
+    int64_t end = 0;
+    for (const detail::CxiChunk &chunk : mChunks) {
+        if (chunk.bufferOffset != end || chunk.size <= 0 || chunk.size > bufferSize - end || chunk.fileOffset < 0 ||
+            chunk.storedSize <= 0 || (compressed ? chunk.storedSize > chunk.size : chunk.storedSize != chunk.size) ||
+            (bayer && chunk.bufferOffset % rowSize != 0)) {
+            throw IOError(MODULE, "Invalid chunk table");
+        }
+        end += chunk.size;
+    }
+    if (end != bufferSize) {
+        throw IOError(MODULE, "Invalid chunk table");
+    }
+
+    if (header.metadataSize < 0 || header.metadataSize > MAX_METADATA_SIZE) {
+        throw IOError(MODULE, "Invalid metadata size: " + std::to_string(header.metadataSize));
+    }
+    if (header.metadataSize > 0) {
+        std::vector<uint8_t> data(header.metadataSize);
+        mStream->read(reinterpret_cast<char *>(data.data()), data.size());
+        if (mStream->fail()) {
+            throw IOError(MODULE, "Failed to read metadata");
+        }
+
+        MetadataReader reader(data.data(), data.size());
+        reader(mMetadata.emplace());
+    }
+
+    mDescriptor = {layout, pixelRepresentation};
+}
+
+Image8u CxiReader::read8u() {
+    LOG_SCOPE_F(INFO, "Read CXI image (8 bits)");
+    LOG_S(INFO) << "Path: " << path();
+
+    return read<uint8_t>();
+}
+
+Image16u CxiReader::read16u() {
+    LOG_SCOPE_F(INFO, "Read CXI image (16 bits)");
+    LOG_S(INFO) << "Path: " << path();
+
+    return read<uint16_t>();
+}
+
+Imagef CxiReader::readf() {
+    LOG_SCOPE_F(INFO, "Read CXI image (float)");
+    LOG_S(INFO) << "Path: " << path();
+
+    return read<float>();
+}
+
+std::optional<ExifMetadata> CxiReader::readExif() const {
+    if (!mMetadata) {
+        return std::nullopt;
+    }
+    return mMetadata->exifMetadata;
+}
+
+void CxiReader::readMetadata(std::optional<ImageMetadata> &metadata) const {
+    if (mMetadata) {
+        metadata = mMetadata;
+    }
+}
+
+template <typename T>
+Image<T> CxiReader::read() {
+    validateType<T>();
+
+    // Each read maps the file again, so that images adopting the mapping do not share their pixels
+    auto input = std::make_shared<detail::MappedInput>(ownsStream() ? path() : ""s, *mStream);
+
+    for (const detail::CxiChunk &chunk : mChunks) {
+        if (static_cast<uint64_t>(chunk.fileOffset) + static_cast<uint64_t>(chunk.storedSize) > input->size()) {
+            throw IOError(MODULE, "Truncated image data");
+        }
+    }
+
+    const detail::CxiChunk &first = mChunks.front();
+    if (input->mapped() && mCompression == ImageWriter::CxiCompression::NONE && mChunks.size() == 1 &&
+        first.fileOffset % DATA_ALIGNMENT == 0) {
+        // The image adopts the private mapping, which is released along with the image
+        T *buffer = reinterpret_cast<T *>(const_cast<uint8_t *>(input->data() + first.fileOffset));
+        return Image<T>::adopted(layoutDescriptor(), buffer, [input](T *) {});
+    }
+
+    Image<T> image(layoutDescriptor());
+    auto *buffer = reinterpret_cast<uint8_t *>(image.data());
+
+    const LayoutDescriptor &layout = image.layoutDescriptor();
+    const int64_t rowSize = layout.planes[0].rowStride * sizeof(T);
+
+    detail::parallelFor(mChunks.size(), options().numThreads, [&](int i) {
+        const detail::CxiChunk &chunk = mChunks[i];
+        const uint8_t *data = input->data() + chunk.fileOffset;
+        if (chunk.storedSize == chunk.size) {
+            std::copy_n(data, chunk.size, buffer + chunk.bufferOffset);
+            return;
+        }
+
+        if (mCompression == ImageWriter::CxiCompression::BAYER) {
+            auto *samples = reinterpret_cast<uint16_t *>(buffer + chunk.bufferOffset);
+            if (!bayerCodec(layout).decode(
+                        data, chunk.storedSize, samples, chunk.bufferOffset / rowSize, chunk.size / sizeof(uint16_t))) {
+                throw IOError(MODULE, "Failed to decompress image data");
+            }
+            return;
+        }
+
+#ifdef HAVE_ZSTD
+        const size_t size = ZSTD_decompress(buffer + chunk.bufferOffset, chunk.size, data, chunk.storedSize);
+        if (ZSTD_isError(size) || size != static_cast<size_t>(chunk.size)) {
+            throw IOError(MODULE, "Failed to decompress image data");
+        }
+#else
+        throw IOError(MODULE, "Cannot read compressed image, zstd support is disabled");
+#endif
+    });
+
+    return image;
+}
+
+void CxiWriter::write(const Image8u &image) const {
+    LOG_SCOPE_F(INFO, "Write CXI image (8 bits)");
+    LOG_S(INFO) << "Path: " << path();
+
+    writeImpl<uint8_t>(image);
+}
+
+void CxiWriter::write(const Image16u &image) const {
+    LOG_SCOPE_F(INFO, "Write CXI image (16 bits)");
+    LOG_S(INFO) << "Path: " << path();
+
+    writeImpl<uint16_t>(image);
+}
+
+void CxiWriter::write(const Imagef &image) const {
+    LOG_SCOPE_F(INFO, "Write CXI image (float)");
+    LOG_S(INFO) << "Path: " << path();
+
+    writeImpl<float>(image);
+}
+
+template <typename T>
+void CxiWriter::writeImpl(const Image<T> &image) const {
+    // The buffer is stored as is, thus it must match the layout that will be rebuilt when reading, which is not the
+    // case of borrowed or cropped images
+    const LayoutDescriptor layout = LayoutDescriptor::Builder(image.layoutDescriptor()).build();
+    if (!image.allocated() || image.buffer() != image.data() || image.size() != layout.requiredBufferSize() ||
+        !samePlanes(layout, image.layoutDescriptor())) {
+        writeImpl<T>(Image<T>(layout, image));
+        return;
+    }
+
+    const CxiCompression compression = options().cxiCompression;
+#ifndef HAVE_ZSTD
+    if (compression == CxiCompression::ZSTD) {
+        throw IOError(MODULE, "Cannot write compressed image, zstd support is disabled");
+    }
+#endif
+    if (compression == CxiCompression::BAYER && !isBayerImage(pixelRepresentation<T>(), layout)) {
+        throw IOError(MODULE, "Bayer compression requires a 16 bits Bayer or quad Bayer image");
+    }
+
+    const auto *buffer = reinterpret_cast<const uint8_t *>(image.data());
+    const int64_t bufferSize = image.size() * sizeof(T);
+    const int64_t rowSize = layout.planes[0].rowStride * sizeof(T);
+
+    std::vector<detail::CxiChunk> chunks;
+    switch (compression) {
+        case CxiCompression::NONE:
+            chunks = {{0, bufferSize, 0, bufferSize}};
+            break;
+        case CxiCompression::ZSTD:
+            chunks = splitChunks(layout, bufferSize, sizeof(T));
+            break;
+        case CxiCompression::BAYER:
+            chunks = splitBands(layout, bufferSize);
+            break;
+    }
+    std::vector<std::vector<uint8_t>> compressed(chunks.size());
+
+    if (compression != CxiCompression::NONE) {
+        detail::parallelFor(chunks.size(), options().numThreads, [&](int i) {
+            detail::CxiChunk &chunk = chunks[i];
+            std::vector<uint8_t> &data = compressed[i];
+
+            if (compression == CxiCompression::BAYER) {
+                const auto *samples = reinterpret_cast<const uint16_t *>(buffer + chunk.bufferOffset);
+                data = bayerCodec(layout).encode(samples, chunk.bufferOffset / rowSize, chunk.size / sizeof(uint16_t));
+            } else {
+#ifdef HAVE_ZSTD
+                data.resize(ZSTD_compressBound(chunk.size));
+                const size_t size = ZSTD_compress(
+                        data.data(), data.size(), buffer + chunk.bufferOffset, chunk.size, options().compressionLevel);
+                if (ZSTD_isError(size)) {
+                    throw IOError(MODULE, "Failed to compress image data: "s + ZSTD_getErrorName(size));
+                }
+                data.resize(size);
+#endif
+            }
+
+            // Incompressible chunks are stored as is
+            if (data.size() < static_cast<size_t>(chunk.size)) {
+                chunk.storedSize = data.size();
+            } else {
+                data.clear();
+            }
+        });
+    }
+
+    MetadataWriter metadata;
+    if (options().metadata) {
+        metadata(*options().metadata);
+    }
+
+    FileHeader header{};
+    std::copy_n(CxiReader::SIGNATURE, sizeof(CxiReader::SIGNATURE), header.signature);
+    header.version = VERSION;
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.pixelRepresentation = static_cast<int32_t>(pixelRepresentation<T>());
+    header.compression = static_cast<int32_t>(options().cxiCompression);
+    header.imageLayout = static_cast<int32_t>(layout.imageLayout);
+    header.pixelType = static_cast<int32_t>(layout.pixelType);
+    header.pixelPrecision = layout.pixelPrecision;
+    header.width = layout.width;
+    header.height = layout.height;
+    header.numPlanes = layout.numPlanes;
+    header.widthAlignment = layout.widthAlignment;
+    header.heightAlignment = layout.heightAlignment;
+    header.sizeAlignment = layout.sizeAlignment;
+    header.border = layout.border;
+    for (int i = 0; i < image::detail::MAX_NUM_PLANES; ++i) {
+        const PlaneDescriptor &plane = layout.planes[i];
+        header.planes[i] = {plane.index, plane.subsample, plane.offset, plane.rowStride, plane.pixelStride};
+    }
+    header.bufferSize = bufferSize;
+    header.numChunks = chunks.size();
+    header.metadataSize = metadata.data().size();
+
+    const int64_t headerSize = sizeof(FileHeader) + chunks.size() * sizeof(detail::CxiChunk) + metadata.data().size();
+    const int64_t dataOffset = (headerSize + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT;
+
+    int64_t fileOffset = dataOffset;
+    for (detail::CxiChunk &chunk : chunks) {
+        chunk.fileOffset = fileOffset;
+        fileOffset += chunk.storedSize;
+    }
+
+    // A file is written to a temporary file renamed over the path once complete. Images memory mapped from the previous
+    // file keep reading its content, where truncating it would make them fault.
+    const std::string tempPath = path() + ".tmp";
+    std::ofstream file;
+    if (ownsStream()) {
+        file.open(tempPath, std::ios::binary);
+        if (!file) {
+            throw IOError(MODULE, "Cannot open file for writing: " + tempPath);
+        }
+    }
+
+    std::ostream *output = file.is_open() ? &file : stream();
+    output->write(reinterpret_cast<const char *>(&header), sizeof(header));
+    output->write(reinterpret_cast<const char *>(chunks.data()), chunks.size() * sizeof(detail::CxiChunk));
+    output->write(reinterpret_cast<const char *>(metadata.data().data()), metadata.data().size());
+
+    const std::vector<char> padding(dataOffset - headerSize, 0);
+    output->write(padding.data(), padding.size());
+
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        const auto *data = compressed[i].empty() ? buffer + chunks[i].bufferOffset : compressed[i].data();
+        output->write(reinterpret_cast<const char *>(data), chunks[i].storedSize);
+    }
+
+    if (file.is_open()) {
+        file.close();
+        // Platforms not replacing an existing file on rename do not map files either, the file can be removed first
+        if (file.fail() || (std::rename(tempPath.c_str(), path().c_str()) != 0 &&
+                            (std::remove(path().c_str()) != 0 || std::rename(tempPath.c_str(), path().c_str()) != 0))) {
+            std::remove(tempPath.c_str());
+            throw IOError(MODULE, "Failed to write image");
+        }
+    }
+
+    if (output->fail()) {
+        throw IOError(MODULE, "Failed to write image");
+    }
+}
+
+} // namespace cxximg
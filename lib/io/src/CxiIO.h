@@ -0,0 +1,87 @@
+// Copyright 2023-2025 Emmanuel Chaboud
+//
+/// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "cxximg/io/ImageReader.h"
+#include "cxximg/io/ImageWriter.h"
+
+#include "cxximg/util/File.h"
+
+#include <cstring>
+#include <vector>
+
+namespace cxximg {
+
+namespace detail {
+
+/// Contiguous range of the image buffer, stored compressed or not.
+struct CxiChunk final {
+    int64_t bufferOffset; // offset in the image buffer, in bytes
+    int64_t size;         // uncompressed size, in bytes
+    int64_t fileOffset;   // offset in the file, in bytes
+    int64_t storedSize;   // size in the file, equal to size when stored uncompressed
+};
+
+} // namespace detail
+
+class CxiReader final : public ImageReader {
+public:
+    static constexpr uint8_t SIGNATURE[8] = {0x89, 'C', 'X', 'I', '\r', '\n', 0x1A, '\n'};
+
+    static bool accept(const std::string &path, const uint8_t *signature, bool signatureValid) {
+        if (!signatureValid) {
+            return file::extension(path) == "cxi";
+        }
+        return std::memcmp(signature, SIGNATURE, sizeof(SIGNATURE)) == 0;
+    }
+
+    using ImageReader::ImageReader;
+
+    void initialize() override;
+
+    Image8u read8u() override;
+    Image16u read16u() override;
+    Imagef readf() override;
+
+    std::optional<ExifMetadata> readExif() const override;
+    void readMetadata(std::optional<ImageMetadata> &metadata) const override;
+
+private:
+    template <typename T>
+    Image<T> read();
+
+    ImageWriter::CxiCompression mCompression = ImageWriter::CxiCompression::NONE;
+    std::vector<detail::CxiChunk> mChunks;
+    std::optional<ImageMetadata> mMetadata;
+};
+
+class CxiWriter final : public ImageWriter {
+public:
+    static bool accept(const std::string &path) { return file::extension(path) == "cxi"; }
+
+    using ImageWriter::ImageWriter;
+
+    bool acceptDescriptor([[maybe_unused]] const LayoutDescriptor &descriptor) const override { return true; }
+
+    void write(const Image8u &image) const override;
+    void write(const Image16u &image) const override;
+    void write(const Imagef &image) const override;
+
+private:
+    template <typename T>
+    void writeImpl(const Image<T> &image) const;
+};
+
+} // namespace cxximg
@@ -14,8 +14,12 @@
 
 #include "DngIO.h"
 
+#include "Parallel.h"
+
 #include "cxximg/math/ColorSpace.h"
+#include "cxximg/math/math.h"
 
+#include <dng_area_task.h>
 #include <dng_color_space.h>
 #include <dng_color_spec.h>
 #include <dng_file_stream.h>
@@ -25,6 +29,9 @@
 #include <dng_info.h>
 #include <loguru.hpp>
 
+#include <algorithm>
+#include <mutex>
+#include <optional>
 #include <unordered_map>
 
 using namespace std::string_literals;
@@ -80,6 +87,206 @@ private:
     std::ostream *mStream;
 };
 
+/// Converts the pixels of the given area from one buffer to another.
+template <typename Src, typename Dst>
+void transferPixels(const dng_pixel_buffer &src, dng_pixel_buffer &dst, const dng_rect &area) {
+    for (uint32 plane = 0; plane < src.fPlanes; ++plane) {
+        for (int32 row = area.t; row < area.b; ++row) {
+            const auto *srcPixel = static_cast<const Src *>(src.ConstPixel(row, area.l, plane));
+            auto *dstPixel = static_cast<Dst *>(dst.DirtyPixel(row, area.l, plane));
+
+            for (int32 col = area.l; col < area.r; ++col) {
+                *dstPixel = *srcPixel;
+
+                srcPixel += src.fColStep;
+                dstPixel += dst.fColStep;
+            }
+        }
+    }
+}
+
+/// dng_image storing its pixels in an external pixel buffer, so that the SDK reads and writes it without any copy.
+/// The buffer may only cover a part of the image bounds, e.g. the active area, and have a wider pixel type than the
+/// image. Tiles not fully stored in the buffer go through a temporary buffer.
+class DngBufferImage final : public dng_image {
+public:
+    explicit DngBufferImage(const dng_pixel_buffer &buffer)
+        : DngBufferImage(buffer.fArea, buffer.fPixelType, buffer) {}
+
+    DngBufferImage(const dng_rect &bounds, uint32 pixelType, const dng_pixel_buffer &buffer)
+        : dng_image(bounds, buffer.fPlanes, pixelType), mBuffer(buffer) {}
+
+protected:
+    void AcquireTileBuffer(dng_tile_buffer &buffer, const dng_rect &area, bool dirty) const override {
+        buffer.fArea = area;
+        buffer.fPlane = 0;
+        buffer.fPlanes = Planes();
+        buffer.fPixelType = PixelType();
+        buffer.fPixelSize = PixelSize();
+        buffer.fDirty = dirty;
+
+        if (PixelType() == mBuffer.fPixelType && (area & mBuffer.fArea) == area) {
+            buffer.fRowStep = mBuffer.fRowStep;
+            buffer.fColStep = mBuffer.fColStep;
+            buffer.fPlaneStep = mBuffer.fPlaneStep;
+            buffer.fData = const_cast<void *>(mBuffer.ConstPixel(area.t, area.l, mBuffer.fPlane));
+            return;
+        }
+
+        // Interleaved temporary buffer
+        buffer.fColStep = Planes();
+        buffer.fRowStep = Planes() * area.W();
+        buffer.fPlaneStep = 1;
+
+        std::vector<uint8_t> scratch(static_cast<size_t>(buffer.fRowStep) * area.H() * PixelSize());
+        buffer.fData = scratch.data();
+
+        if (!dirty) {
+            storeTile(mBuffer, buffer, area & mBuffer.fArea);
+        }
+
+        std::lock_guard<std::mutex> lock(mScratchMutex);
+        mScratches.emplace(buffer.fData, std::move(scratch));
+    }
+
+    void ReleaseTileBuffer(dng_tile_buffer &buffer) const override {
+        std::vector<uint8_t> scratch;
+        {
+            std::lock_guard<std::mutex> lock(mScratchMutex);
+            if (auto it = mScratches.find(buffer.fData); it != mScratches.end()) {
+                scratch = std::move(it->second);
+                mScratches.erase(it);
+            }
+        }
+
+        if (buffer.fDirty && !scratch.empty()) {
+            dng_pixel_buffer dst = mBuffer;
+            storeTile(buffer, dst, buffer.fArea & mBuffer.fArea);
+        }
+    }
+
+private:
+    static void storeTile(const dng_pixel_buffer &src, dng_pixel_buffer &dst, const dng_rect &area) {
+        if (area.IsEmpty()) {
+            return;
+        }
+
+        if (src.fPixelType == ttByte && dst.fPixelType == ttShort) {
+            transferPixels<uint8_t, uint16_t>(src, dst, area);
+        } else if (src.fPixelType == ttShort && dst.fPixelType == ttShort) {
+            transferPixels<uint16_t, uint16_t>(src, dst, area);
+        } else if (src.fPixelType == ttFloat && dst.fPixelType == ttFloat) {
+            transferPixels<float, float>(src, dst, area);
+        } else if (src.fPixelType == ttShort && dst.fPixelType == ttByte) {
+            // Temporary buffer filled from the image memory
+            transferPixels<uint16_t, uint8_t>(src, dst, area);
+        } else {
+            ThrowProgramError("Unsupported pixel type conversion");
+        }
+    }
+
+    dng_pixel_buffer mBuffer;
+
+    mutable std::mutex mScratchMutex;
+    mutable std::unordered_map<void *, std::vector<uint8_t>> mScratches;
+};
+
+/// DNG host running area tasks, like tile decoding and encoding, on multiple threads.
+/// It can also make the next created image store its pixels in a given buffer instead of allocating its own memory.
+class DngHost final : public dng_host {
+public:
+    explicit DngHost(int numThreads) : mNumThreads(detail::resolveNumThreads(numThreads)) {}
+
+    uint32 PerformAreaTaskThreads() override { return mNumThreads; }
+
+    void PerformAreaTask(dng_area_task &task, const dng_rect &area, dng_area_task_progress *progress) override {
+        // Split the area into one band of whole unit cells per thread. Tile reading and writing tasks pass a dummy area
+        // of a few rows per thread and share the tiles between threads, so every thread must get a non-empty band.
+        const int32 unitHeight = std::max<int32>(task.UnitCell().v, 1);
+        const int32 numCells = math::ceilDivision<int32>(area.H(), unitHeight);
+        const uint32 threadCount = std::min({mNumThreads, task.MaxThreads(), static_cast<uint32>(numCells)});
+        if (threadCount <= 1) {
+            dng_host::PerformAreaTask(task, area, progress);
+            return;
+        }
+
+        const dng_point tileSize = task.FindTileSize(area);
+        task.Start(threadCount, area, tileSize, &Allocator(), Sniffer());
+
+        const auto bandTop = [&](int i) {
+            return area.t + static_cast<int32>(int64_t(numCells) * i / threadCount) * unitHeight;
+        };
+
+        detail::parallelFor(threadCount, threadCount, [&](int i) {
+            dng_rect band = area;
+            band.t = bandTop(i);
+            band.b = std::min(area.b, bandTop(i + 1));
+            task.ProcessOnThread(i, band, tileSize, Sniffer(), progress);
+        });
+
+        task.Finish(threadCount);
+    }
+
+    dng_image *Make_dng_image(const dng_rect &bounds, uint32 planes, uint32 pixelType) override {
+        if (mTarget && (bounds & mTarget->fArea) == mTarget->fArea && planes == mTarget->fPlanes &&
+            (pixelType == mTarget->fPixelType || (pixelType == ttByte && mTarget->fPixelType == ttShort))) {
+            auto *image = new DngBufferImage(bounds, pixelType, *mTarget);
+            mTarget.reset();
+            mTargetUsed = true;
+            return image;
+        }
+        return dng_host::Make_dng_image(bounds, planes, pixelType);
+    }
+
+    /// Makes the next image containing the buffer area, with the same planes and a compatible pixel type, store its
+    /// pixels in the given buffer.
+    void setTarget(const dng_pixel_buffer &buffer) {
+        mTarget = buffer;
+        mTargetUsed = false;
+    }
+
+    /// Returns whether the target buffer has been used since the last call to setTarget(), and clears it.
+    bool releaseTarget() {
+        mTarget.reset();
+        return mTargetUsed;
+    }
+
+private:
+    uint32 mNumThreads;
+    std::optional<dng_pixel_buffer> mTarget;
+    bool mTargetUsed = false;
+};
+
+/// Returns a pixel buffer describing the memory of the given image.
+template <typename T>
+dng_pixel_buffer makePixelBuffer(const Image<T> &image) {
+    const LayoutDescriptor &layout = image.layoutDescriptor();
+
+    dng_pixel_buffer buffer;
+    buffer.fArea = dng_rect(image.height(), image.width());
+    buffer.fPlane = 0;
+    buffer.fPlanes = image.numPlanes();
+    buffer.fRowStep = static_cast<int32>(layout.planes[0].rowStride);
+    buffer.fColStep = static_cast<int32>(layout.planes[0].pixelStride);
+    buffer.fPlaneStep = image.numPlanes() > 1 ? static_cast<int32>(layout.planes[1].offset - layout.planes[0].offset) : 1;
+    buffer.fPixelType = std::is_floating_point_v<T> ? ttFloat : ttShort;
+    buffer.fPixelSize = sizeof(T);
+    buffer.fData = const_cast<T *>(image.data() + layout.planes[0].offset);
+    return buffer;
+}
+
+/// Maps the pixels of the image through the linearization LUT, by bands of rows on multiple threads.
+void linearize(Image16u &image, const std::vector<uint16_t> &lut, int numThreads) {
+    const int bandHeight = math::ceilDivision(image.height(), detail::resolveNumThreads(numThreads));
+    const int numBands = math::ceilDivision(image.height(), bandHeight);
+
+    detail::parallelFor(numBands, numBands, [&](int i) {
+        const int y = i * bandHeight;
+        ImageView16u band = image[Rect{0, y, image.width(), std::min(bandHeight, image.height() - y)}];
+        band = expr::lut(expr::min(band, lut.size() - 1), lut);
+    });
+}
+
 } // namespace
 
 DngReader::DngReader(const std::string &path, std::istream *stream, const Options &options)
@@ -116,7 +323,7 @@ static PixelType cfaPatternToPixelType(const dng_ifd *ifd) {
 
 void DngReader::initialize() {
     mStream = std::make_unique<DngReadStream>(ImageReader::mStream);
-    mHost = std::make_unique<dng_host>();
+    mHost = std::make_unique<DngHost>(options().numThreads);
     mInfo = std::make_unique<dng_info>();
     mNegative.reset(mHost->Make_dng_negative());
 
@@ -199,9 +406,6 @@ Image<T> DngReader::read() {
     validateType<T>();
 
     try {
-        // Read stage 1 image from negative
-        mNegative->ReadStage1Image(*mHost, *mStream, *mInfo);
-
         const dng_ifd *ifd = mInfo->fIFD[mInfo->fMainIndex];
         const dng_linearization_info *linearizationInfo = mNegative->GetLinearizationInfo();
         const bool hasLinearizationTable = !std::is_floating_point_v<T> && linearizationInfo &&
@@ -209,7 +413,36 @@ Image<T> DngReader::read() {
 
         Image<T> image(layoutDescriptor());
 
-        if (!hasLinearizationTable) {
+        std::vector<uint16_t> lut;
+        if (hasLinearizationTable) {
+            LOG_S(INFO) << "Found DNG linearization table";
+
+            lut.assign(linearizationInfo->fLinearizationTable->Buffer_uint16(),
+                       linearizationInfo->fLinearizationTable->Buffer_uint16() +
+                               (linearizationInfo->fLinearizationTable->LogicalSize() >> 1));
+        }
+
+        // Tiles are decoded straight into the output image, which covers the active area.
+        auto &host = static_cast<DngHost &>(*mHost);
+        dng_pixel_buffer target = makePixelBuffer(image);
+        target.fArea = ifd->fActiveArea;
+        host.setTarget(target);
+
+        // Read stage 1 image from negative
+        mNegative->ReadStage1Image(*mHost, *mStream, *mInfo);
+
+        if (host.releaseTarget()) {
+            // Do not keep a reference to the output image memory.
+            AutoPtr<dng_image> empty;
+            mNegative->SetStage1Image(empty);
+
+            // Tiles may be released several times while decoding, the LUT is applied once all of them are decoded.
+            if constexpr (!std::is_floating_point_v<T>) {
+                if (hasLinearizationTable) {
+                    linearize(image, lut, options().numThreads);
+                }
+            }
+        } else if (!hasLinearizationTable) {
             const dng_image *stage1 = mNegative->Stage1Image();
             if (stage1->PixelType() != ttShort && stage1->PixelType() != ttFloat) {
                 throw IOError(MODULE, "Unsupported pixel type: " + std::to_string(stage1->PixelType()));
@@ -223,16 +456,10 @@ Image<T> DngReader::read() {
                                     image.data());
             stage1->Get(buffer);
         } else {
-            LOG_S(INFO) << "Found DNG linearization table";
-
             const dng_image *stage1 = mNegative->Stage1Image();
             dng_const_tile_buffer srcBuffer(*stage1, stage1->Bounds());
             void *srcData = const_cast<void *>(srcBuffer.ConstPixel(0, 0, 0));
 
-            std::vector<uint16_t> lut(linearizationInfo->fLinearizationTable->Buffer_uint16(),
-                                      linearizationInfo->fLinearizationTable->Buffer_uint16() +
-                                              (linearizationInfo->fLinearizationTable->LogicalSize() >> 1));
-
             LayoutDescriptor srcDescriptor = LayoutDescriptor::Builder(layoutDescriptor())
                                                      .width(stage1->Width())
                                                      .height(stage1->Height())
@@ -529,25 +756,11 @@ void DngWriter::write(const Imagef &image) const {
 
 template <typename T>
 void DngWriter::writeImpl(const Image<T> &image) const {
-    if (image.imageLayout() == ImageLayout::PLANAR && image.numPlanes() > 1) {
-        // Planar to interleaved conversion
-        return writeImpl<T>(image::convertLayout(image, ImageLayout::INTERLEAVED));
-    }
-
     try {
-        dng_host host;
-
-        const uint32 pixelType = std::is_floating_point_v<T> ? ttFloat : ttShort;
-        AutoPtr<dng_image> stage1(
-                host.Make_dng_image(dng_rect(image.height(), image.width()), image.numPlanes(), pixelType));
+        DngHost host(options().numThreads);
 
-        dng_pixel_buffer buffer(stage1->Bounds(),
-                                0,
-                                stage1->Planes(),
-                                stage1->PixelType(),
-                                pcInterleaved,
-                                const_cast<void *>(reinterpret_cast<const void *>(image.data())));
-        stage1->Put(buffer);
+        // The stage 1 image reads the input image memory as is, whatever its layout.
+        AutoPtr<dng_image> stage1(new DngBufferImage(makePixelBuffer(image)));
 
         AutoPtr<dng_negative> negative(host.Make_dng_negative());
         negative->SetFloatingPoint(std::is_floating_point_v<T>);
@@ -690,9 +903,14 @@ void DngWriter::writeImpl(const Image<T> &image) const {
         negative->SetStage1Image(stage1);
         negative->SynchronizeMetadata();
 
-        DngWriteStream writeStream(mStream);
+        DngWriteStream writeStream(stream());
         dng_image_writer writer;
-        writer.WriteDNG(host, writeStream, *negative.Get());
+        writer.WriteDNG(host,
+                        writeStream,
+                        *negative.Get(),
+                        nullptr,
+                        dngVersion_SaveDefault,
+                        options.dngCompression == DngCompression::NONE);
     } catch (const dng_exception &except) {
         throw IOError(MODULE, "Writing failed with error code: " + std::to_string(except.ErrorCode()));
     }
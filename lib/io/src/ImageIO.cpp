@@ -16,8 +16,10 @@
 
 #include "BmpIO.h"
 #include "CfaIO.h"
+#include "CxiIO.h"
 #include "MipiRawIO.h"
 #include "PlainIO.h"
+#include "QoiIO.h"
 
 #ifdef HAVE_DNG
 #include "DngIO.h"
@@ -115,6 +117,10 @@ std::unique_ptr<ImageReader> makeReader(const std::string &path,
             return std::make_unique<CfaReader>(path, stream, options);
         }
 
+        if (CxiReader::accept(path, signature, signatureValid)) {
+            return std::make_unique<CxiReader>(path, stream, options);
+        }
+
 #ifdef HAVE_JPEG
         if (JpegReader::accept(path, signature, signatureValid)) {
             return std::make_unique<JpegReader>(path, stream, options);
@@ -133,6 +139,10 @@ std::unique_ptr<ImageReader> makeReader(const std::string &path,
         }
 #endif
 
+        if (QoiReader::accept(path, signature, signatureValid)) {
+            return std::make_unique<QoiReader>(path, stream, options);
+        }
+
 #ifdef HAVE_TIFF
         if (TiffReader::accept(path, signature, signatureValid)) {
             return std::make_unique<TiffReader>(path, stream, options);
@@ -185,6 +195,10 @@ std::unique_ptr<ImageWriter> makeWriter(const std::string &path,
         return std::make_unique<CfaWriter>(path, stream, options);
     }
 
+    if (CxiWriter::accept(path)) {
+        return std::make_unique<CxiWriter>(path, stream, options);
+    }
+
 #ifdef HAVE_DNG
     if (DngWriter::accept(path)) {
         return std::make_unique<DngWriter>(path, stream, options);
@@ -217,6 +231,10 @@ std::unique_ptr<ImageWriter> makeWriter(const std::string &path,
     }
 #endif
 
+    if (QoiWriter::accept(path)) {
+        return std::make_unique<QoiWriter>(path, stream, options);
+    }
+
 #ifdef HAVE_TIFF
     if (TiffWriter::accept(path)) {
         return std::make_unique<TiffWriter>(path, stream, options);
@@ -13,6 +13,10 @@
 // limitations under the License.
 
 #include "JpegIO.h"
+#include "Parallel.h"
+
+#include "cxximg/math/math.h"
+#include "cxximg/util/MemoryStream.h"
 
 #ifdef HAVE_EXIF
 #include "Exif.h"
@@ -21,10 +25,18 @@
 #include <jpeglib.h>
 #include <loguru.hpp>
 
+#include <algorithm>
 #include <csetjmp>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <vector>
 
 using namespace std::string_literals;
 
+namespace fs = std::filesystem;
+
 namespace cxximg {
 
 static const std::string MODULE = "JPEG";
@@ -33,6 +45,10 @@ namespace {
 
 constexpr int CHUNK_SIZE = 65536;
 
+constexpr uint8_t MARKER_SOF0 = 0xC0; ///< baseline frame header
+constexpr uint8_t MARKER_SOF2 = 0xC2; ///< progressive frame header
+constexpr uint8_t MARKER_SOS = 0xDA;  ///< start of scan
+
 struct JpegErrorMgr {
     jpeg_error_mgr pub;    ///< "public" fields
     jmp_buf setjmp_buffer; ///< for return to caller
@@ -51,6 +67,14 @@ struct JpegWriteStream {
     uint8_t buffer[CHUNK_SIZE]; ///< start of buffer
 };
 
+bool isYuv420(const jpeg_decompress_struct *dinfo) {
+    const jpeg_component_info *components = dinfo->comp_info;
+
+    return dinfo->jpeg_color_space == JCS_YCbCr && components[0].h_samp_factor == 2 &&
+           components[0].v_samp_factor == 2 && components[1].h_samp_factor == 1 &&
+           components[1].v_samp_factor == 1 && components[2].h_samp_factor == 1 && components[2].v_samp_factor == 1;
+}
+
 void errorExit(j_common_ptr info) {
     // info->err really points to a CustomErrorMgr struct, so coerce pointer
     auto *jerr = reinterpret_cast<JpegErrorMgr *>(info->err);
@@ -165,6 +189,333 @@ static void setupJpegDestinationStream(j_compress_ptr cinfo, std::ostream *strea
     dest->stream = stream;
 }
 
+/// Encodes the image as a standalone JPEG, optionally with a restart marker at each MCU row.
+static void compress(const ImageView8u &image,
+                     std::ostream *stream,
+                     int quality,
+                     const std::vector<uint8_t> &exif,
+                     bool restartMarkers) {
+    jpeg_compress_struct cinfo{};
+
+    JpegErrorMgr jerr{};
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = errorExit;
+    jerr.pub.output_message = outputMessage;
+
+    if (setjmp(jerr.setjmp_buffer)) { // NOLINT(cert-err52-cpp)
+        jpeg_destroy_compress(&cinfo);
+        throw IOError(MODULE, "Writing failed");
+    }
+
+    jpeg_create_compress(&cinfo);
+
+    setupJpegDestinationStream(&cinfo, stream);
+
+    cinfo.image_width = image.width();
+    cinfo.image_height = image.height();
+    cinfo.input_components = image.numPlanes();
+
+    switch (image.pixelType()) {
+        case PixelType::GRAYSCALE:
+            cinfo.in_color_space = JCS_GRAYSCALE;
+            break;
+        case PixelType::RGB:
+            cinfo.in_color_space = JCS_RGB;
+            break;
+        case PixelType::YUV:
+            cinfo.in_color_space = JCS_YCbCr;
+            break;
+        default:
+            throw IOError(MODULE, "Unsupported pixel type: "s + toString(image.pixelType()));
+    }
+
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, FALSE);
+
+    if (restartMarkers) {
+        // Standard Huffman tables, so that all the bands share the same ones
+        cinfo.optimize_coding = FALSE;
+        cinfo.restart_in_rows = 1;
+    }
+
+    if (image.imageLayout() == ImageLayout::YUV_420) {
+        cinfo.raw_data_in = TRUE;
+    }
+
+    jpeg_start_compress(&cinfo, TRUE);
+
+    if (!exif.empty()) {
+        jpeg_write_marker(&cinfo, JPEG_APP0 + 1, exif.data(), exif.size());
+    }
+
+    if (image.imageLayout() == ImageLayout::YUV_420) {
+        uint8_t *yRows[16];
+        uint8_t *uRows[8];
+        uint8_t *vRows[8];
+
+        uint8_t **rows[3] = {yRows, uRows, vRows};
+        const int chromaHeight = image.plane(1).height();
+        for (int y = 0; y < image.height(); y += 16) {
+            // Last rows are replicated to fill the last MCU row
+            for (int i = 0; i < 16; i++) {
+                yRows[i] = image.buffer(0, std::min(y + i, image.height() - 1));
+            }
+            for (int i = 0; i < 8; i++) {
+                uRows[i] = image.buffer(1, std::min((y >> 1) + i, chromaHeight - 1));
+                vRows[i] = image.buffer(2, std::min((y >> 1) + i, chromaHeight - 1));
+            }
+
+            jpeg_write_raw_data(&cinfo, rows, 16);
+        }
+    } else {
+        for (int y = 0; y < image.height(); ++y) {
+            auto *row = image.buffer(0, y);
+            jpeg_write_scanlines(&cinfo, &row, 1);
+        }
+    }
+
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+}
+
+/// Returns the offset of the entropy-coded data following the first start of scan segment, along with the offset of
+/// the frame height field.
+static size_t findScanData(const std::vector<char> &jpeg, size_t *heightOffset) {
+    const auto *data = reinterpret_cast<const uint8_t *>(jpeg.data());
+
+    size_t pos = 2; // skip SOI
+    while (pos + 4 <= jpeg.size()) {
+        if (data[pos] != 0xFF) {
+            throw IOError(MODULE, "Invalid marker at offset " + std::to_string(pos));
+        }
+
+        const uint8_t marker = data[pos + 1];
+        const size_t length = (data[pos + 2] << 8) | data[pos + 3];
+
+        if (marker >= MARKER_SOF0 && marker <= MARKER_SOF2) {
+            *heightOffset = pos + 5;
+        }
+
+        pos += 2 + length;
+
+        if (marker == MARKER_SOS) {
+            return pos;
+        }
+    }
+
+    throw IOError(MODULE, "Start of scan not found");
+}
+
+#ifdef HAVE_EXIF
+/// Location of a marker segment, preceding the first scan.
+struct Segment final {
+    std::streamoff offset; ///< offset of the marker
+    std::streamoff size;   ///< size including the marker
+    uint8_t marker;
+    bool exif; ///< whether this is an EXIF APP1 segment
+};
+
+/// Parses the marker segments preceding the first scan. The offset of the SOS marker is stored in scanOffset.
+static std::vector<Segment> readSegments(std::istream &stream, std::streamoff *scanOffset) {
+    uint8_t header[4];
+
+    stream.read(reinterpret_cast<char *>(header), 2);
+    if (!stream || header[0] != 0xFF || header[1] != 0xD8) {
+        throw IOError(MODULE, "Not a JPEG file");
+    }
+
+    std::vector<Segment> segments;
+    while (true) {
+        const std::streamoff offset = stream.tellg();
+
+        stream.read(reinterpret_cast<char *>(header), 4);
+        if (!stream || header[0] != 0xFF) {
+            throw IOError(MODULE, "Invalid marker at offset " + std::to_string(offset));
+        }
+
+        const uint8_t marker = header[1];
+        if (marker == MARKER_SOS) {
+            *scanOffset = offset;
+            return segments;
+        }
+
+        const std::streamoff size = 2 + ((header[2] << 8) | header[3]);
+
+        bool exif = false;
+        if (marker == JPEG_APP0 + 1 && size >= 10) {
+            char identifier[6];
+            stream.read(identifier, sizeof(identifier));
+            exif = stream && memcmp(identifier, "Exif\0\0", sizeof(identifier)) == 0;
+        }
+
+        segments.push_back({offset, size, marker, exif});
+        stream.seekg(offset + size);
+    }
+}
+
+/// Builds a marker segment with the given payload.
+static std::vector<uint8_t> makeSegment(int marker, const uint8_t *payload, size_t size) {
+    if (size + 2 > 0xFFFF) {
+        throw IOError(MODULE, "Segment payload is too large: " + std::to_string(size));
+    }
+
+    std::vector<uint8_t> segment(4 + size);
+    segment[0] = 0xFF;
+    segment[1] = static_cast<uint8_t>(marker);
+    segment[2] = static_cast<uint8_t>((size + 2) >> 8);
+    segment[3] = static_cast<uint8_t>((size + 2) & 0xFF);
+    std::copy_n(payload, size, segment.begin() + 4);
+
+    return segment;
+}
+
+/// Builds the EXIF segment replacing the existing one if any. A smaller payload is padded with zeros, which EXIF parsers
+/// ignore, so that the segment can be overwritten in place.
+static std::vector<uint8_t> makeExifSegment(std::vector<uint8_t> payload,
+                                            const std::vector<Segment> &segments,
+                                            std::vector<Segment>::const_iterator exifIt) {
+    if (exifIt != segments.end() && static_cast<std::streamoff>(payload.size() + 4) < exifIt->size) {
+        payload.resize(exifIt->size - 4, 0);
+    }
+    return makeSegment(JPEG_APP0 + 1, payload.data(), payload.size());
+}
+
+/// Writes the headers preceding the first scan, with the EXIF segment replaced, or inserted after the SOI and APP0
+/// segments.
+static void writeHeaders(std::istream &input,
+                         std::ostream &output,
+                         const std::vector<Segment> &segments,
+                         std::vector<Segment>::const_iterator exifIt,
+                         const std::vector<uint8_t> &exifSegment) {
+    static constexpr char SOI[] = {static_cast<char>(0xFF), static_cast<char>(0xD8)};
+    output.write(SOI, sizeof(SOI));
+
+    const auto writeExifSegment = [&]() {
+        output.write(reinterpret_cast<const char *>(exifSegment.data()),
+                     static_cast<std::streamsize>(exifSegment.size()));
+    };
+
+    bool exifWritten = false;
+    std::vector<char> buffer;
+    for (const auto &segment : segments) {
+        if (!exifWritten && (segment.exif || (exifIt == segments.end() && segment.marker != JPEG_APP0))) {
+            writeExifSegment();
+            exifWritten = true;
+        }
+        if (segment.exif) {
+            continue;
+        }
+
+        buffer.resize(segment.size);
+        input.seekg(segment.offset);
+        input.read(buffer.data(), segment.size);
+        output.write(buffer.data(), segment.size);
+    }
+    if (!exifWritten) {
+        writeExifSegment();
+    }
+}
+
+/// Replaces or inserts the EXIF segment of the JPEG file at the given path. A grown segment is written with the rest of
+/// the file into a temporary file, renamed over the path.
+static void updateExifFile(const std::string &path, const std::vector<uint8_t> &payload) {
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    if (!file) {
+        throw IOError(MODULE, "Cannot open file for reading: " + path);
+    }
+
+    std::streamoff scanOffset = 0;
+    const std::vector<Segment> segments = readSegments(file, &scanOffset);
+    const auto exifIt = std::find_if(segments.begin(), segments.end(), [](const Segment &s) { return s.exif; });
+    const std::vector<uint8_t> exifSegment = makeExifSegment(payload, segments, exifIt);
+
+    if (exifIt != segments.end() && exifIt->size == static_cast<std::streamoff>(exifSegment.size())) {
+        file.seekp(exifIt->offset);
+        file.write(reinterpret_cast<const char *>(exifSegment.data()),
+                   static_cast<std::streamsize>(exifSegment.size()));
+
+        if (!file) {
+            throw IOError(MODULE, "Writing failed");
+        }
+        return;
+    }
+
+    const std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream ofs(tmpPath, std::ios::binary);
+        if (!ofs) {
+            throw IOError(MODULE, "Cannot open file for writing: " + tmpPath);
+        }
+
+        writeHeaders(file, ofs, segments, exifIt, exifSegment);
+
+        // Copy the rest of the file verbatim
+        std::vector<char> buffer(CHUNK_SIZE);
+        file.seekg(scanOffset);
+        while (file) {
+            file.read(buffer.data(), CHUNK_SIZE);
+            ofs.write(buffer.data(), file.gcount());
+        }
+
+        if (!ofs) {
+            throw IOError(MODULE, "Writing failed");
+        }
+    }
+
+    file.close();
+
+    std::error_code error;
+    fs::rename(tmpPath, path, error);
+    if (error) {
+        fs::remove(tmpPath, error);
+        throw IOError(MODULE, "Cannot replace file: " + path);
+    }
+}
+
+/// Replaces or inserts the EXIF segment of the JPEG stream in place. When the segment grows, the data following the
+/// headers is moved towards the end by chunks, starting from the last one.
+static void updateExif(std::iostream &io, const std::vector<uint8_t> &payload) {
+    io.seekg(0);
+
+    std::streamoff scanOffset = 0;
+    const std::vector<Segment> segments = readSegments(io, &scanOffset);
+    const auto exifIt = std::find_if(segments.begin(), segments.end(), [](const Segment &s) { return s.exif; });
+    const std::vector<uint8_t> exifSegment = makeExifSegment(payload, segments, exifIt);
+
+    if (exifIt != segments.end() && exifIt->size == static_cast<std::streamoff>(exifSegment.size())) {
+        io.seekp(exifIt->offset);
+        io.write(reinterpret_cast<const char *>(exifSegment.data()), static_cast<std::streamsize>(exifSegment.size()));
+    } else {
+        std::ostringstream headers;
+        writeHeaders(io, headers, segments, exifIt, exifSegment);
+        const std::string data = headers.str();
+        const std::streamoff shift = static_cast<std::streamoff>(data.size()) - scanOffset;
+
+        io.seekg(0, std::ios::end);
+        std::streamoff end = io.tellg();
+
+        std::vector<char> buffer(CHUNK_SIZE);
+        while (end > scanOffset) {
+            const std::streamoff size = std::min<std::streamoff>(CHUNK_SIZE, end - scanOffset);
+            end -= size;
+
+            io.seekg(end);
+            io.read(buffer.data(), size);
+            io.seekp(end + shift);
+            io.write(buffer.data(), size);
+        }
+
+        io.seekp(0);
+        io.write(data.data(), static_cast<std::streamsize>(data.size()));
+    }
+
+    if (!io) {
+        throw IOError(MODULE, "Writing failed");
+    }
+    io.seekp(0, std::ios::end);
+}
+#endif
+
 void JpegDecompressDeleter::operator()(jpeg_decompress_struct *dinfo) const {
     jpeg_destroy_decompress(dinfo);
 
@@ -194,18 +545,35 @@ void JpegReader::initialize() {
     jpeg_save_markers(dinfo, JPEG_APP0 + 1, 0xFFFF);
     jpeg_read_header(dinfo, TRUE);
 
-    LayoutDescriptor::Builder builder = LayoutDescriptor::Builder(dinfo->image_width, dinfo->image_height)
+    const int downscale = options().downscale;
+    if (downscale < 1) {
+        throw IOError(MODULE, "Invalid downscale factor: " + std::to_string(downscale));
+    }
+    if (downscale > 1) {
+        // Downscaling is done in the DCT domain, using the largest supported factor not above the requested one
+        dinfo->scale_num = 1;
+        dinfo->scale_denom = (downscale >= 8) ? 8 : (downscale >= 4) ? 4 : 2;
+    }
+    jpeg_calc_output_dimensions(dinfo);
+
+    LayoutDescriptor::Builder builder = LayoutDescriptor::Builder(dinfo->output_width, dinfo->output_height)
                                                 .pixelPrecision(8);
 
     if (dinfo->num_components == 1) {
         builder.pixelType(PixelType::GRAYSCALE);
     } else if (dinfo->num_components == 3) {
-        builder.imageLayout(ImageLayout::INTERLEAVED);
-        if (options().jpegDecodingMode == ImageReader::JpegDecodingMode::YUV) {
-            builder.pixelType(PixelType::YUV);
+        const auto decodingMode = options().jpegDecodingMode;
+
+        if (decodingMode == ImageReader::JpegDecodingMode::YUV_420 && downscale == 1 && isYuv420(dinfo)) {
+            // Output the decoded planes as is, padded to whole MCUs
+            builder.imageLayout(ImageLayout::YUV_420).pixelType(PixelType::YUV).widthAlignment(16).heightAlignment(16);
+            dinfo->out_color_space = JCS_YCbCr;
+            dinfo->raw_data_out = TRUE;
+        } else if (decodingMode != ImageReader::JpegDecodingMode::RGB) {
+            builder.imageLayout(ImageLayout::INTERLEAVED).pixelType(PixelType::YUV);
             dinfo->out_color_space = JCS_YCbCr;
         } else {
-            builder.pixelType(PixelType::RGB);
+            builder.imageLayout(ImageLayout::INTERLEAVED).pixelType(PixelType::RGB);
         }
     } else {
         throw IOError(MODULE, "Unsupported number of components: " + std::to_string(dinfo->num_components));
@@ -229,9 +597,39 @@ Image8u JpegReader::read8u() {
 
     jpeg_start_decompress(dinfo);
 
+    if (dinfo->raw_data_out) {
+        JSAMPROW yRows[16];
+        JSAMPROW uRows[8];
+        JSAMPROW vRows[8];
+
+        JSAMPARRAY planes[3] = {yRows, uRows, vRows};
+        while (dinfo->output_scanline < dinfo->output_height) {
+            // Image height is aligned to 16, so all rows of the last MCU row are valid
+            const int y = static_cast<int>(dinfo->output_scanline);
+            for (int i = 0; i < 16; i++) {
+                yRows[i] = image.buffer(0, y + i);
+            }
+            for (int i = 0; i < 8; i++) {
+                uRows[i] = image.buffer(1, (y >> 1) + i);
+                vRows[i] = image.buffer(2, (y >> 1) + i);
+            }
+
+            jpeg_read_raw_data(dinfo, planes, 16);
+        }
+
+        jpeg_finish_decompress(dinfo);
+
+        return image;
+    }
+
+    std::vector<JSAMPROW> rows(image.height());
     for (int y = 0; y < image.height(); ++y) {
-        auto *row = image.buffer(0, y);
-        jpeg_read_scanlines(dinfo, &row, 1);
+        rows[y] = image.buffer(0, y);
+    }
+
+    // Let the decoder output as many rows as it can per call
+    while (dinfo->output_scanline < dinfo->output_height) {
+        jpeg_read_scanlines(dinfo, &rows[dinfo->output_scanline], dinfo->output_height - dinfo->output_scanline);
     }
 
     jpeg_finish_decompress(dinfo);
@@ -263,51 +661,9 @@ void JpegWriter::write(const Image8u &image) const {
     LOG_SCOPE_F(INFO, "Write JPEG");
     LOG_S(INFO) << "Path: " << path();
 
-    jpeg_compress_struct cinfo{};
-
-    JpegErrorMgr jerr{};
-    cinfo.err = jpeg_std_error(&jerr.pub);
-    jerr.pub.error_exit = errorExit;
-    jerr.pub.output_message = outputMessage;
-
-    if (setjmp(jerr.setjmp_buffer)) { // NOLINT(cert-err52-cpp)
-        jpeg_destroy_compress(&cinfo);
-        throw IOError(MODULE, "Writing failed");
-    }
-
-    jpeg_create_compress(&cinfo);
-
-    setupJpegDestinationStream(&cinfo, mStream);
-
-    cinfo.image_width = image.width();
-    cinfo.image_height = image.height();
-    cinfo.input_components = image.numPlanes();
-
-    switch (image.pixelType()) {
-        case PixelType::GRAYSCALE:
-            cinfo.in_color_space = JCS_GRAYSCALE;
-            break;
-        case PixelType::RGB:
-            cinfo.in_color_space = JCS_RGB;
-            break;
-        case PixelType::YUV:
-            cinfo.in_color_space = JCS_YCbCr;
-            break;
-        default:
-            throw IOError(MODULE, "Unsupported pixel type: "s + toString(image.pixelType()));
-    }
-
-    jpeg_set_defaults(&cinfo);
-    jpeg_set_quality(&cinfo, options().jpegQuality, FALSE);
-
-    if (image.imageLayout() == ImageLayout::YUV_420) {
-        cinfo.raw_data_in = TRUE;
-    }
-
-    jpeg_start_compress(&cinfo, TRUE);
+    std::vector<uint8_t> exif;
 
 #ifdef HAVE_EXIF
-    // Write EXIF
     const auto &metadata = options().metadata;
     if (metadata) {
         ExifMem *mem = exif_mem_new_default();
@@ -319,7 +675,7 @@ void JpegWriter::write(const Image8u &image) const {
         uint32_t exifLength = 0;
         exif_data_save_data(data, &exifBuffer, &exifLength);
 
-        jpeg_write_marker(&cinfo, JPEG_APP0 + 1, exifBuffer, exifLength);
+        exif.assign(exifBuffer, exifBuffer + exifLength);
 
         free(exifBuffer); // NOLINT(cppcoreguidelines-no-malloc)
         exif_mem_unref(mem);
@@ -327,90 +683,59 @@ void JpegWriter::write(const Image8u &image) const {
     }
 #endif
 
-    if (image.imageLayout() == ImageLayout::YUV_420) {
-        uint8_t *yRows[16];
-        uint8_t *uRows[8];
-        uint8_t *vRows[8];
-
-        uint8_t **rows[3] = {yRows, uRows, vRows};
-        for (int y = 0; y < image.height(); y += 16) {
-            // Jpeg library ignores the rows whose indices are greater than height
-            for (int i = 0; i < 16; i++) {
-                yRows[i] = image.buffer(0, y + i);
-            }
-            for (int i = 0; i < 8; i++) {
-                uRows[i] = image.buffer(1, (y >> 1) + i);
-                vRows[i] = image.buffer(2, (y >> 1) + i);
-            }
-
-            jpeg_write_raw_data(&cinfo, rows, 16);
-        }
-    } else {
-        for (int y = 0; y < image.height(); ++y) {
-            auto *row = image.buffer(0, y);
-            jpeg_write_scanlines(&cinfo, &row, 1);
-        }
-    }
-
-    jpeg_finish_compress(&cinfo);
-    jpeg_destroy_compress(&cinfo);
-}
+    // Bands are made of a multiple of 8 MCU rows, so that restart marker numbering continues from one band to the next
+    const int numThreads = detail::resolveNumThreads(options().numThreads);
+    const int mcuHeight = (image.numPlanes() == 1) ? 8 : 16; // color images use 2x2 luma sampling
+    const int numMcuGroups = math::ceilDivision(image.height(), 8 * mcuHeight);
+    const int numBands = std::min(numThreads, numMcuGroups);
 
-#ifdef HAVE_EXIF
-void JpegWriter::writeExif(const ExifMetadata &exif) const {
-    std::ifstream ifs(path(), std::ios::binary);
-    if (!ifs) {
-        throw IOError(MODULE, "Cannot open file for reading: " + path());
+    if (numBands <= 1) {
+        compress(image, stream(), options().jpegQuality, exif, false);
+        return;
     }
 
-    jpeg_decompress_struct dinfo{};
-    jpeg_compress_struct cinfo{};
+    const int bandHeight = math::ceilDivision(numMcuGroups, numBands) * 8 * mcuHeight;
 
-    // Initialize the JPEG decompression object
-    JpegErrorMgr jderr{};
-    dinfo.err = jpeg_std_error(&jderr.pub);
-    jderr.pub.error_exit = errorExit;
-    jderr.pub.output_message = outputMessage;
+    std::vector<VectorOutputStream> bands(math::ceilDivision(image.height(), bandHeight));
+    detail::parallelFor(static_cast<int>(bands.size()), numThreads, [&](int i) {
+        const int y = i * bandHeight;
+        const ImageView8u band = image[Rect{0, y, image.width(), std::min(bandHeight, image.height() - y)}];
 
-    if (setjmp(jderr.setjmp_buffer)) { // NOLINT(cert-err52-cpp)
-        jpeg_destroy_compress(&cinfo);
-        jpeg_destroy_decompress(&dinfo);
-        throw IOError(MODULE, "Reading failed");
-    }
+        compress(band, &bands[i], options().jpegQuality, (i == 0) ? exif : std::vector<uint8_t>(), true);
+    });
 
-    jpeg_create_decompress(&dinfo);
-    setupJpegSourceStream(&dinfo, &ifs);
+    // Stitch the entropy-coded segments, using the headers of the first band with the full image height
+    static constexpr char RST7[] = {static_cast<char>(0xFF), static_cast<char>(JPEG_RST0 + 7)};
+    static constexpr char EOI[] = {static_cast<char>(0xFF), static_cast<char>(JPEG_EOI)};
 
-    // Initialize the JPEG compression object
-    JpegErrorMgr jcerr{};
-    cinfo.err = jpeg_std_error(&jcerr.pub);
-    jcerr.pub.error_exit = errorExit;
-    jcerr.pub.output_message = outputMessage;
+    for (size_t i = 0; i < bands.size(); ++i) {
+        const std::vector<char> &data = bands[i].vec();
 
-    if (setjmp(jcerr.setjmp_buffer)) { // NOLINT(cert-err52-cpp)
-        jpeg_destroy_compress(&cinfo);
-        jpeg_destroy_decompress(&dinfo);
-        throw IOError(MODULE, "Writing failed");
-    }
+        size_t heightOffset = 0;
+        const size_t scanOffset = findScanData(data, &heightOffset);
 
-    jpeg_create_compress(&cinfo);
+        if (i == 0) {
+            std::vector<char> headers(data.begin(), data.begin() + scanOffset);
+            headers[heightOffset] = static_cast<char>(image.height() >> 8);
+            headers[heightOffset + 1] = static_cast<char>(image.height() & 0xFF);
 
-    // Read source DCT coefficients
-    jpeg_read_header(&dinfo, TRUE);
-    jvirt_barray_ptr *coefficients = jpeg_read_coefficients(&dinfo);
+            stream()->write(headers.data(), static_cast<std::streamsize>(headers.size()));
+        } else {
+            stream()->write(RST7, sizeof(RST7));
+        }
 
-    // Initialize destination compression parameters from source values
-    jpeg_copy_critical_parameters(&dinfo, &cinfo);
+        // Skip the EOI marker of each band
+        stream()->write(data.data() + scanOffset, static_cast<std::streamsize>(data.size() - scanOffset - 2));
+    }
 
-    // Close input file and open output file
-    ifs.close();
-    std::ofstream ofs(path(), std::ios::binary);
-    setupJpegDestinationStream(&cinfo, &ofs);
+    stream()->write(EOI, sizeof(EOI));
+}
 
-    // Write destination DCT coefficients
-    jpeg_write_coefficients(&cinfo, coefficients);
+#ifdef HAVE_EXIF
+void JpegWriter::writeExif(const ExifMetadata &exif) const {
+    LOG_SCOPE_F(INFO, "Write JPEG EXIF");
+    LOG_S(INFO) << "Path: " << path();
 
-    // Write EXIF
     ExifMem *mem = exif_mem_new_default();
     ExifData *data = exif_data_new();
 
@@ -420,18 +745,38 @@ void JpegWriter::writeExif(const ExifMetadata &exif) const {
     uint32_t exifLength = 0;
     exif_data_save_data(data, &exifBuffer, &exifLength);
 
-    jpeg_write_marker(&cinfo, JPEG_APP0 + 1, exifBuffer, exifLength);
+    const std::vector<uint8_t> payload(exifBuffer, exifBuffer + exifLength);
 
     free(exifBuffer); // NOLINT(cppcoreguidelines-no-malloc)
     exif_mem_unref(mem);
     exif_data_unref(data);
 
-    // Finish compression and release memory
-    jpeg_finish_compress(&cinfo);
-    jpeg_finish_decompress(&dinfo);
+    if (ownsStream()) {
+        // Pending writes are flushed, and the file is reopened after being possibly replaced
+        closeStream();
+        updateExifFile(path(), payload);
+        return;
+    }
 
-    jpeg_destroy_compress(&cinfo);
-    jpeg_destroy_decompress(&dinfo);
+    std::ostream *output = stream(std::ios::in | std::ios::out);
+    output->flush();
+
+    if (auto *io = dynamic_cast<std::iostream *>(output)) {
+        updateExif(*io, payload);
+        io->flush();
+    } else if (auto *vectorStream = dynamic_cast<VectorOutputStream *>(output)) {
+        // The vector can be read back and sought through its buffer
+        std::iostream io(vectorStream->rdbuf());
+        updateExif(io, payload);
+    } else if (auto *stringStream = dynamic_cast<std::ostringstream *>(output)) {
+        // The string buffer is write-only, edit a copy of it
+        std::stringstream io(stringStream->str());
+        updateExif(io, payload);
+        stringStream->str(io.str());
+        stringStream->seekp(0, std::ios::end);
+    } else {
+        throw IOError(MODULE, "EXIF update requires a readable output stream");
+    }
 }
 #endif
 
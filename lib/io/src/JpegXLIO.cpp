@@ -13,6 +13,9 @@
 // limitations under the License.
 
 #include "JpegXLIO.h"
+#include "MappedInput.h"
+
+#include "cxximg/math/math.h"
 
 #ifdef HAVE_EXIF
 #include "Exif.h"
@@ -20,47 +23,363 @@
 
 #include <jxl/decode.h>
 #include <jxl/encode_cxx.h>
+#include <jxl/thread_parallel_runner_cxx.h>
+#include <jxl/version.h>
 #include <loguru.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <mutex>
+
 using namespace std::string_literals;
 
 namespace cxximg {
 
 static const std::string MODULE = "JPEGXL";
 
+/// Processes the decoder input. Unless the whole input has already been given to the decoder, it is read from the
+/// stream by chunks, the unused bytes being kept at the beginning of the buffer.
+static JxlDecoderStatus processInput(JxlDecoder *decoder,
+                                     bool wholeInput,
+                                     std::istream &stream,
+                                     uint8_t *buffer,
+                                     size_t bufferSize,
+                                     size_t &remainingBytes) {
+    if (wholeInput) {
+        const JxlDecoderStatus status = JxlDecoderProcessInput(decoder);
+        if (status == JXL_DEC_NEED_MORE_INPUT) {
+            throw IOError(MODULE, "Unexpected end of stream");
+        }
+        return status;
+    }
+
+    stream.read(reinterpret_cast<char *>(buffer + remainingBytes), bufferSize - remainingBytes);
+    const std::streamsize bytesRead = stream.gcount();
+
+    if (bytesRead <= 0 && remainingBytes == 0) {
+        throw IOError(MODULE, "Unexpected end of stream");
+    }
+    const size_t availableBytes = remainingBytes + bytesRead;
+
+    JxlDecoderSetInput(decoder, buffer, availableBytes);
+    const JxlDecoderStatus status = JxlDecoderProcessInput(decoder);
+
+    remainingBytes = JxlDecoderReleaseInput(decoder);
+    if (remainingBytes > 0) {
+        // Move the remaining unused data to the beginning of the buffer
+        memmove(buffer, buffer + (availableBytes - remainingBytes), remainingBytes);
+    }
+
+    return status;
+}
+
+/// Creates a thread parallel runner, or returns nullptr when single-threaded. A runner must not be used concurrently
+/// by several codecs, thus each reader or writer owns its own.
+static JxlThreadParallelRunnerPtr makeParallelRunner(int numThreads) {
+    if (numThreads == 1) {
+        return nullptr;
+    }
+
+    const size_t numWorkerThreads =
+            (numThreads > 0) ? static_cast<size_t>(numThreads) : JxlThreadParallelRunnerDefaultNumWorkerThreads();
+    return JxlThreadParallelRunnerMake(nullptr, numWorkerThreads);
+}
+
+/// Destination of a region of interest and/or downscaled decoding.
+template <typename T>
+struct RegionOutput final {
+    ImageView<T> image;
+    Rect region;
+    int downscale;
+    int numChannels;
+    std::vector<float> sums;                /// Accumulator shared by the decoding threads, only used when downscaling
+    std::unique_ptr<std::mutex[]> rowLocks; /// Serialize the accumulation into each output row
+};
+
+template <typename T>
+static void *initRegionOutput(void *opaque, size_t /*numThreads*/, size_t /*numPixelsPerThread*/) {
+    auto *output = static_cast<RegionOutput<T> *>(opaque);
+
+    if (output->downscale > 1) {
+        const size_t size = static_cast<size_t>(output->image.width()) * output->image.height() * output->numChannels;
+        output->sums.assign(size, 0.0f);
+        output->rowLocks = std::make_unique<std::mutex[]>(output->image.height());
+    }
+    return output;
+}
+
+template <typename T>
+static void runRegionOutput(
+        void *opaque, size_t /*threadId*/, size_t x, size_t y, size_t numPixels, const void *pixels) {
+    auto *output = static_cast<RegionOutput<T> *>(opaque);
+    const Rect &region = output->region;
+
+    const int xi0 = static_cast<int>(x);
+    const int yi = static_cast<int>(y);
+    if (yi < region.y || yi >= region.y + region.height) {
+        return;
+    }
+
+    const int x0 = std::max(xi0, region.x);
+    const int x1 = std::min(xi0 + static_cast<int>(numPixels), region.x + region.width);
+    const int numChannels = output->numChannels;
+    const T *src = static_cast<const T *>(pixels);
+
+    if (output->downscale == 1) {
+        for (int xi = x0; xi < x1; ++xi) {
+            for (int c = 0; c < numChannels; ++c) {
+                output->image(xi - region.x, yi - region.y, c) = src[(xi - xi0) * numChannels + c];
+            }
+        }
+    } else {
+        // Threads decoding neighbouring groups may contribute to the same output pixels
+        const int downscale = output->downscale;
+        const int outputY = (yi - region.y) / downscale;
+        float *row = output->sums.data() + static_cast<size_t>(outputY) * output->image.width() * numChannels;
+        const std::lock_guard<std::mutex> lock(output->rowLocks[outputY]);
+
+        for (int xi = x0; xi < x1; ++xi) {
+            float *dst = row + ((xi - region.x) / downscale) * numChannels;
+            for (int c = 0; c < numChannels; ++c) {
+                dst[c] += static_cast<float>(src[(xi - xi0) * numChannels + c]);
+            }
+        }
+    }
+}
+
+static void destroyRegionOutput(void * /*opaque*/) {}
+
+/// Averages the accumulated samples of each downscaled pixel into the output image.
+template <typename T>
+static void resolveRegionOutput(RegionOutput<T> &output) {
+    const Rect &region = output.region;
+    const int downscale = output.downscale;
+    const int numChannels = output.numChannels;
+
+    for (int y = 0; y < output.image.height(); ++y) {
+        const int countY = std::min(downscale, region.height - y * downscale);
+        for (int x = 0; x < output.image.width(); ++x) {
+            const int countX = std::min(downscale, region.width - x * downscale);
+            const size_t index = (static_cast<size_t>(y) * output.image.width() + x) * numChannels;
+
+            for (int c = 0; c < numChannels; ++c) {
+                const float value = output.sums[index + c] / static_cast<float>(countX * countY);
+                if constexpr (std::is_floating_point_v<T>) {
+                    output.image(x, y, c) = value;
+                } else {
+                    output.image(x, y, c) = static_cast<T>(std::lround(value));
+                }
+            }
+        }
+    }
+}
+
+// Chunked frames and output processors are available from libjxl 0.10
+#if JPEGXL_MAJOR_VERSION > 0 || JPEGXL_MINOR_VERSION >= 10
+#define CXXIMG_JXL_CHUNKED_FRAME
+
+/// Chunked frame input source pulling row bands from an image view.
+/// Bands are directly exposed when the view is packed interleaved, otherwise they are converted on the fly.
+template <typename T>
+struct ChunkedImageSource final {
+    ImageView<T> image;
+    JxlPixelFormat format;
+    bool packed; /// Whether color channels can be read directly from the image buffer
+
+    static void getColorChannelsPixelFormat(void *opaque, JxlPixelFormat *pixelFormat) {
+        *pixelFormat = static_cast<ChunkedImageSource *>(opaque)->format;
+    }
+
+    static const void *getColorChannelDataAt(
+            void *opaque, size_t xpos, size_t ypos, size_t xsize, size_t ysize, size_t *rowOffset) {
+        const auto *source = static_cast<ChunkedImageSource *>(opaque);
+        const ImageView<T> &image = source->image;
+        const int numChannels = source->format.num_channels;
+
+        if (source->packed) {
+            const auto &plane = image.layoutDescriptor().planes[0];
+            *rowOffset = plane.rowStride * sizeof(T);
+            return image.buffer(0, static_cast<int>(ypos)) + xpos * plane.pixelStride;
+        }
+
+        T *band = new T[xsize * ysize * numChannels];
+        for (size_t y = 0; y < ysize; ++y) {
+            T *dst = band + y * xsize * numChannels;
+            for (size_t x = 0; x < xsize; ++x) {
+                for (int c = 0; c < numChannels; ++c) {
+                    dst[x * numChannels + c] = image(static_cast<int>(xpos + x), static_cast<int>(ypos + y), c);
+                }
+            }
+        }
+        *rowOffset = xsize * numChannels * sizeof(T);
+        return band;
+    }
+
+    static void getExtraChannelPixelFormat(void *opaque, size_t /*ecIndex*/, JxlPixelFormat *pixelFormat) {
+        *pixelFormat = static_cast<ChunkedImageSource *>(opaque)->format;
+        pixelFormat->num_channels = 1;
+    }
+
+    static const void *getExtraChannelDataAt(
+            void *opaque, size_t /*ecIndex*/, size_t xpos, size_t ypos, size_t xsize, size_t ysize, size_t *rowOffset) {
+        const auto *source = static_cast<ChunkedImageSource *>(opaque);
+        const int alpha = source->image.numPlanes() - 1;
+
+        T *band = new T[xsize * ysize];
+        for (size_t y = 0; y < ysize; ++y) {
+            for (size_t x = 0; x < xsize; ++x) {
+                band[y * xsize + x] = source->image(static_cast<int>(xpos + x), static_cast<int>(ypos + y), alpha);
+            }
+        }
+        *rowOffset = xsize * sizeof(T);
+        return band;
+    }
+
+    static void releaseBuffer(void *opaque, const void *buffer) {
+        const auto *source = static_cast<ChunkedImageSource *>(opaque);
+        const T *begin = source->image.buffer();
+        const T *end = begin + source->image.layoutDescriptor().requiredBufferSize();
+        const T *data = static_cast<const T *>(buffer);
+
+        // Only converted bands have been allocated
+        if (std::less<const T *>()(data, begin) || !std::less<const T *>()(data, end)) {
+            delete[] data;
+        }
+    }
+};
+
+/// Encoder output processor writing directly to a stream.
+struct StreamOutputProcessor final {
+    static constexpr size_t BUFFER_SIZE = 65536;
+
+    std::ostream *stream;
+    std::streampos start;
+    std::vector<uint8_t> buffer = std::vector<uint8_t>(BUFFER_SIZE);
+
+    static void *getBuffer(void *opaque, size_t *size) {
+        auto *output = static_cast<StreamOutputProcessor *>(opaque);
+        *size = std::min(*size, output->buffer.size());
+        return output->buffer.data();
+    }
+
+    static void releaseBuffer(void *opaque, size_t writtenBytes) {
+        auto *output = static_cast<StreamOutputProcessor *>(opaque);
+        output->stream->write(reinterpret_cast<const char *>(output->buffer.data()),
+                              static_cast<std::streamsize>(writtenBytes));
+    }
+
+    static void seek(void *opaque, uint64_t position) {
+        auto *output = static_cast<StreamOutputProcessor *>(opaque);
+        output->stream->seekp(output->start + static_cast<std::streamoff>(position));
+    }
+
+    static void setFinalizedPosition(void * /*opaque*/, uint64_t /*finalizedPosition*/) {}
+};
+
+/// Encodes the image by row bands, writing the codestream to the output stream as it is produced.
+template <typename T>
+static void writeChunked(JxlEncoder *encoder,
+                         JxlEncoderFrameSettings *frameSettings,
+                         const JxlPixelFormat &format,
+                         const ImageView<T> &image,
+                         std::ostream &stream) {
+    const auto &planes = image.layoutDescriptor().planes;
+    bool packed = (planes[0].pixelStride == image.numPlanes());
+    for (int c = 1; c < image.numPlanes(); ++c) {
+        packed &= (planes[c].offset == planes[0].offset + c);
+    }
+
+    StreamOutputProcessor output = {&stream, stream.tellp()};
+
+    JxlEncoderOutputProcessor outputProcessor = {&output,
+                                                 StreamOutputProcessor::getBuffer,
+                                                 StreamOutputProcessor::releaseBuffer,
+                                                 StreamOutputProcessor::seek,
+                                                 StreamOutputProcessor::setFinalizedPosition};
+    if (output.start == std::streampos(-1)) {
+        // Non seekable stream, the encoder will buffer the sections it needs to patch
+        outputProcessor.seek = nullptr;
+    }
+    if (JxlEncoderSetOutputProcessor(encoder, outputProcessor) != JXL_ENC_SUCCESS) {
+        throw IOError(MODULE, "Failed to set output processor");
+    }
+
+    ChunkedImageSource<T> source = {image, format, packed};
+
+    JxlChunkedFrameInputSource inputSource = {&source,
+                                              ChunkedImageSource<T>::getColorChannelsPixelFormat,
+                                              ChunkedImageSource<T>::getColorChannelDataAt,
+                                              ChunkedImageSource<T>::getExtraChannelPixelFormat,
+                                              ChunkedImageSource<T>::getExtraChannelDataAt,
+                                              ChunkedImageSource<T>::releaseBuffer};
+
+    if (JxlEncoderAddChunkedFrame(frameSettings, JXL_TRUE, inputSource) != JXL_ENC_SUCCESS) {
+        throw IOError(MODULE, "Encoder error");
+    }
+    if (JxlEncoderFlushInput(encoder) != JXL_ENC_SUCCESS) {
+        throw IOError(MODULE, "Encoder error");
+    }
+    if (!stream) {
+        throw IOError(MODULE, "Failed to write to output stream");
+    }
+}
+
+#endif
+
 void JxlDecoderDeleter::operator()(JxlDecoder *decoder) const {
     JxlDecoderDestroy(decoder);
 }
 
+void JxlParallelRunnerDeleter::operator()(void *runner) const {
+    JxlThreadParallelRunnerDestroy(runner);
+}
+
+JpegXLReader::JpegXLReader(const std::string &path, std::istream *stream, const Options &options)
+    : ImageReader(path, stream, options) {
+}
+
+JpegXLReader::~JpegXLReader() = default;
+
 void JpegXLReader::initialize() {
     mDecoder.reset(JxlDecoderCreate(nullptr));
+    mRunner.reset(makeParallelRunner(options().numThreads).release());
+
+    if (mRunner) {
+        if (JxlDecoderSetParallelRunner(mDecoder.get(), JxlThreadParallelRunner, mRunner.get()) != JXL_DEC_SUCCESS) {
+            throw IOError(MODULE, "Failed to set parallel runner");
+        }
+    }
 
     const bool supportBoxDecompression = (JxlDecoderSetDecompressBoxes(mDecoder.get(), JXL_TRUE) == JXL_DEC_SUCCESS);
 
-    JxlDecoderSubscribeEvents(
-            mDecoder.get(),
-            JXL_DEC_BASIC_INFO | JXL_DEC_BOX | JXL_DEC_BOX_COMPLETE | JXL_DEC_FRAME | JXL_DEC_FULL_IMAGE);
+    mDownscale = options().downscale;
+    if (mDownscale < 1) {
+        throw IOError(MODULE, "Invalid downscale factor: " + std::to_string(mDownscale));
+    }
+
+    int events = JXL_DEC_BASIC_INFO | JXL_DEC_BOX | JXL_DEC_BOX_COMPLETE | JXL_DEC_FRAME | JXL_DEC_FULL_IMAGE;
+    if (mDownscale >= 8) {
+        // The DC pass is a 1:8 image, no need to decode further
+        JxlDecoderSetProgressiveDetail(mDecoder.get(), kDC);
+        events |= JXL_DEC_FRAME_PROGRESSION;
+    }
+    JxlDecoderSubscribeEvents(mDecoder.get(), events);
 
     JxlBasicInfo info;
     size_t exifPos = 0;
 
-    while (true) {
-        mStream->read(reinterpret_cast<char *>(mBuffer.data() + mRemainingBytes), CHUNK_SIZE - mRemainingBytes);
-        const std::streamsize bytesRead = mStream->gcount();
+    // Give the whole input at once to the decoder, unless the stream cannot be sought
+    if (mStream->tellg() != std::streampos(-1)) {
+        mInput = std::make_unique<detail::MappedInput>(ownsStream() ? path() : ""s, *mStream);
 
-        if (bytesRead <= 0 && mRemainingBytes == 0) {
-            throw IOError(MODULE, "Unexpected end of stream");
-        }
-        const size_t availableBytes = mRemainingBytes + bytesRead;
-
-        JxlDecoderSetInput(mDecoder.get(), mBuffer.data(), availableBytes);
-        JxlDecoderStatus status = JxlDecoderProcessInput(mDecoder.get());
+        JxlDecoderSetInput(mDecoder.get(), mInput->data(), mInput->size());
+        JxlDecoderCloseInput(mDecoder.get());
+    }
 
-        mRemainingBytes = JxlDecoderReleaseInput(mDecoder.get());
-        if (mRemainingBytes > 0) {
-            // Move the remaining unused data to the beginning of the buffer
-            memmove(mBuffer.data(), mBuffer.data() + (availableBytes - mRemainingBytes), mRemainingBytes);
-        }
+    while (true) {
+        const JxlDecoderStatus status =
+                processInput(mDecoder.get(), mInput != nullptr, *mStream, mBuffer.data(), CHUNK_SIZE, mRemainingBytes);
 
         if (status == JXL_DEC_ERROR) {
             throw IOError(MODULE, "Decoder error");
@@ -90,7 +409,26 @@ void JpegXLReader::initialize() {
         }
     }
 
-    LayoutDescriptor::Builder builder = LayoutDescriptor::Builder(info.xsize, info.ysize)
+    const int fullWidth = static_cast<int>(info.xsize);
+    const int fullHeight = static_cast<int>(info.ysize);
+
+    mRegion = {0, 0, fullWidth, fullHeight};
+    if (options().roi) {
+        const Rect &roi = *options().roi;
+        const int x0 = std::max(roi.x, 0);
+        const int y0 = std::max(roi.y, 0);
+        const int x1 = std::min(roi.x + roi.width, fullWidth);
+        const int y1 = std::min(roi.y + roi.height, fullHeight);
+
+        if (x1 <= x0 || y1 <= y0) {
+            throw IOError(MODULE, "Region of interest does not intersect the image");
+        }
+        mRegion = {x0, y0, x1 - x0, y1 - y0};
+    }
+    mFullFrame = (mDownscale == 1 && mRegion.width == fullWidth && mRegion.height == fullHeight);
+
+    LayoutDescriptor::Builder builder = LayoutDescriptor::Builder(math::ceilDivision(mRegion.width, mDownscale),
+                                                                  math::ceilDivision(mRegion.height, mDownscale))
                                                 .pixelPrecision(info.bits_per_sample);
 
     if (info.num_color_channels == 1 && info.num_extra_channels == 0) {
@@ -127,25 +465,52 @@ Image8u JpegXLReader::read8u() {
     LOG_SCOPE_F(INFO, "Read JPEG XL (8 bits)");
     LOG_S(INFO) << "Path: " << path();
 
-    return read<uint8_t>();
+    Image8u image(layoutDescriptor());
+    read(image);
+    return image;
 }
 
 Image16u JpegXLReader::read16u() {
     LOG_SCOPE_F(INFO, "Read JPEG XL (16 bits)");
     LOG_S(INFO) << "Path: " << path();
 
-    return read<uint16_t>();
+    Image16u image(layoutDescriptor());
+    read(image);
+    return image;
 }
 
 Imagef JpegXLReader::readf() {
     LOG_SCOPE_F(INFO, "Read JPEG XL (float)");
     LOG_S(INFO) << "Path: " << path();
 
-    return read<float>();
+    Imagef image(layoutDescriptor());
+    read(image);
+    return image;
+}
+
+void JpegXLReader::readInto8u(ImageView8u image) {
+    LOG_SCOPE_F(INFO, "Read JPEG XL (8 bits)");
+    LOG_S(INFO) << "Path: " << path();
+
+    read(checkOutput(image));
+}
+
+void JpegXLReader::readInto16u(ImageView16u image) {
+    LOG_SCOPE_F(INFO, "Read JPEG XL (16 bits)");
+    LOG_S(INFO) << "Path: " << path();
+
+    read(checkOutput(image));
+}
+
+void JpegXLReader::readIntof(ImageViewf image) {
+    LOG_SCOPE_F(INFO, "Read JPEG XL (float)");
+    LOG_S(INFO) << "Path: " << path();
+
+    read(checkOutput(image));
 }
 
 template <typename T>
-Image<T> JpegXLReader::read() {
+void JpegXLReader::read(ImageView<T> &image) {
     validateType<T>();
 
     const auto jxlDataType = [](PixelRepresentation pixelRepresentation) {
@@ -165,42 +530,56 @@ Image<T> JpegXLReader::read() {
                              JXL_NATIVE_ENDIAN,
                              0};
 
-    Image<T> image(layoutDescriptor());
-    while (true) {
-        mStream->read(reinterpret_cast<char *>(mBuffer.data() + mRemainingBytes), CHUNK_SIZE - mRemainingBytes);
-        std::streamsize bytesRead = mStream->gcount();
+    RegionOutput<T> regionOutput = {image, mRegion, mDownscale, static_cast<int>(format.num_channels), {}, {}};
 
-        if (bytesRead <= 0 && mRemainingBytes == 0) {
-            throw IOError(MODULE, "Unexpected end of stream");
-        }
-        size_t availableBytes = mRemainingBytes + bytesRead;
-
-        JxlDecoderSetInput(mDecoder.get(), mBuffer.data(), availableBytes);
-        JxlDecoderStatus status = JxlDecoderProcessInput(mDecoder.get());
+    // Pixels are decoded directly into a packed interleaved view, otherwise written by the image out callback
+    const auto &planes = image.layoutDescriptor().planes;
+    bool packed = (planes[0].pixelStride == image.numPlanes() &&
+                   planes[0].rowStride == static_cast<int64_t>(image.width()) * image.numPlanes());
+    for (int c = 1; c < image.numPlanes(); ++c) {
+        packed &= (planes[c].offset == planes[0].offset + c);
+    }
 
-        mRemainingBytes = JxlDecoderReleaseInput(mDecoder.get());
-        if (mRemainingBytes > 0) {
-            // Move the remaining unused data to the beginning of the buffer
-            memmove(mBuffer.data(), mBuffer.data() + (availableBytes - mRemainingBytes), mRemainingBytes);
-        }
+    while (true) {
+        const JxlDecoderStatus status =
+                processInput(mDecoder.get(), mInput != nullptr, *mStream, mBuffer.data(), CHUNK_SIZE, mRemainingBytes);
 
         if (status == JXL_DEC_ERROR) {
             throw IOError(MODULE, "Decoder error");
         }
-        if (status == JXL_DEC_NEED_IMAGE_OUT_BUFFER) {
+        if (status == JXL_DEC_NEED_IMAGE_OUT_BUFFER && !(mFullFrame && packed)) {
+            JxlDecoderSetMultithreadedImageOutCallback(mDecoder.get(),
+                                                       &format,
+                                                       initRegionOutput<T>,
+                                                       runRegionOutput<T>,
+                                                       destroyRegionOutput,
+                                                       &regionOutput);
+        } else if (status == JXL_DEC_NEED_IMAGE_OUT_BUFFER) {
             size_t bufferSize = 0;
             JxlDecoderImageOutBufferSize(mDecoder.get(), &format, &bufferSize);
 
-            if (bufferSize != image.size() * sizeof(T)) {
+            const size_t imageSize = planes[0].rowStride * image.height() * sizeof(T);
+            if (bufferSize != imageSize) {
                 throw IOError(MODULE,
-                              "Buffer size does not match expected image size (expected " +
-                                      std::to_string(image.size() * sizeof(T)) + ", got " + std::to_string(bufferSize) +
-                                      ")");
+                              "Buffer size does not match expected image size (expected " + std::to_string(imageSize) +
+                                      ", got " + std::to_string(bufferSize) + ")");
             }
 
-            JxlDecoderSetImageOutBuffer(mDecoder.get(), &format, image.data(), bufferSize);
+            JxlDecoderSetImageOutBuffer(mDecoder.get(), &format, image.buffer(0), bufferSize);
+        } else if (status == JXL_DEC_FRAME_PROGRESSION) {
+            // DC pass is available, output it and stop decoding
+            if (JxlDecoderFlushImage(mDecoder.get()) != JXL_DEC_SUCCESS) {
+                throw IOError(MODULE, "Failed to flush progressive image");
+            }
+            if (mDownscale > 1) {
+                resolveRegionOutput(regionOutput);
+            }
+            return;
         } else if (status == JXL_DEC_FULL_IMAGE) {
-            return image;
+            if (mDownscale > 1) {
+                resolveRegionOutput(regionOutput);
+            }
+            return;
         } else if (status != JXL_DEC_NEED_MORE_INPUT) {
             throw IOError(MODULE, "Unexpected decoder status: " + std::to_string(status));
         }
@@ -247,13 +626,30 @@ void JpegXLWriter::write(const Imagef &image) const {
 
 template <typename T>
 void JpegXLWriter::writeImpl(const Image<T> &image) const {
-    if (image.imageLayout() == ImageLayout::PLANAR && image.numPlanes() > 1) {
+#ifdef CXXIMG_JXL_CHUNKED_FRAME
+    const bool streaming = options().jxlStreaming;
+#else
+    const bool streaming = false;
+#endif
+
+    if (image.imageLayout() == ImageLayout::PLANAR && image.numPlanes() > 1 && !streaming) {
         // Planar to interleaved conversion
         return writeImpl<T>(image::convertLayout(image, ImageLayout::INTERLEAVED));
     }
+    if (options().jxlStreaming && !streaming) {
+        LOG_S(WARNING) << "JPEG XL streaming encoding requires libjxl 0.10, encoding the full frame";
+    }
 
+    // The runner is declared first, so that it outlives the encoder
+    const JxlThreadParallelRunnerPtr runner = makeParallelRunner(options().numThreads);
     JxlEncoderPtr encoder = JxlEncoderMake(nullptr);
 
+    if (runner) {
+        if (JxlEncoderSetParallelRunner(encoder.get(), JxlThreadParallelRunner, runner.get()) != JXL_ENC_SUCCESS) {
+            throw IOError(MODULE, "Failed to set parallel runner");
+        }
+    }
+
     const auto jxlDataType = []() {
         if constexpr (std::is_same_v<T, uint8_t>) {
             return JXL_TYPE_UINT8;
@@ -327,6 +723,16 @@ void JpegXLWriter::writeImpl(const Image<T> &image) const {
 
     JxlEncoderFrameSettingsSetOption(frameSettings, JXL_ENC_FRAME_SETTING_EFFORT, options().compressionLevel);
 
+#ifdef CXXIMG_JXL_CHUNKED_FRAME
+    if (streaming) {
+        // Streaming input and output for all images larger than one group
+        JxlEncoderFrameSettingsSetOption(frameSettings, JXL_ENC_FRAME_SETTING_BUFFERING, 2);
+
+        writeChunked<T>(encoder.get(), frameSettings, format, image, *stream());
+        return;
+    }
+#endif
+
     JxlEncoderAddImageFrame(frameSettings, &format, static_cast<const void *>(image.data()), image.size() * sizeof(T));
     JxlEncoderCloseInput(encoder.get());
 
@@ -341,7 +747,7 @@ void JpegXLWriter::writeImpl(const Image<T> &image) const {
             throw IOError(MODULE, "Encoder error");
         }
 
-        mStream->write(reinterpret_cast<const char *>(buffer.data()), CHUNK_SIZE - availOut);
+        stream()->write(reinterpret_cast<const char *>(buffer.data()), CHUNK_SIZE - availOut);
 
         if (status == JXL_ENC_SUCCESS) {
             break;
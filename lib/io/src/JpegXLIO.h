@@ -24,10 +24,20 @@ typedef struct JxlDecoderStruct JxlDecoder; // NOLINT
 
 namespace cxximg {
 
+namespace detail {
+
+class MappedInput;
+
+} // namespace detail
+
 struct JxlDecoderDeleter final {
     void operator()(JxlDecoder *decoder) const;
 };
 
+struct JxlParallelRunnerDeleter final {
+    void operator()(void *runner) const;
+};
+
 class JpegXLReader final : public ImageReader {
 public:
     static bool accept(const std::string &path, const uint8_t *signature, bool signatureValid) {
@@ -40,7 +50,8 @@ public:
                 signature[8] == 0x0D && signature[9] == 0x0A && signature[10] == 0x87 && signature[11] == 0x0A);
     }
 
-    using ImageReader::ImageReader;
+    JpegXLReader(const std::string &path, std::istream *stream, const Options &options);
+    ~JpegXLReader() override;
 
     void initialize() override;
 
@@ -48,6 +59,10 @@ public:
     Image16u read16u() override;
     Imagef readf() override;
 
+    void readInto8u(ImageView8u image) override;
+    void readInto16u(ImageView16u image) override;
+    void readIntof(ImageViewf image) override;
+
 #ifdef HAVE_EXIF
     std::optional<ExifMetadata> readExif() const override;
 #endif
@@ -56,11 +71,17 @@ private:
     static constexpr int CHUNK_SIZE = 65536;
 
     template <typename T>
-    Image<T> read();
+    void read(ImageView<T> &image);
 
+    std::unique_ptr<void, JxlParallelRunnerDeleter> mRunner; /// Declared first, so that it outlives the decoder
     std::unique_ptr<JxlDecoder, JxlDecoderDeleter> mDecoder;
 
-    std::array<uint8_t, CHUNK_SIZE> mBuffer;
+    Rect mRegion = {};      /// Decoded region, in full resolution coordinates
+    int mDownscale = 1;     /// Downscaling factor applied to the decoded region
+    bool mFullFrame = true; /// Whether the full frame is decoded at full resolution
+
+    std::unique_ptr<detail::MappedInput> mInput; /// Whole input, unless the stream cannot be sought
+    std::array<uint8_t, CHUNK_SIZE> mBuffer;      /// Input chunk, when the stream cannot be sought
     size_t mRemainingBytes = 0;
 
     std::vector<uint8_t> mExif; /// Exif box
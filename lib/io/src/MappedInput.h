@@ -0,0 +1,116 @@
+// Copyright 2023-2025 Emmanuel Chaboud
+//
+/// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "cxximg/util/MemoryStream.h"
+
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define CXXIMG_HAVE_MMAP
+#endif
+
+namespace cxximg {
+
+namespace detail {
+
+/// Content of a whole input. The file is memory mapped when a path is given and mapping succeeds, memory streams are
+/// used in place, otherwise the stream is read into memory. Mappings are private and copy on write, so that the content
+/// may be adopted as a mutable image buffer without altering the file.
+class MappedInput final {
+public:
+    MappedInput(const std::string &path, std::istream &stream) {
+        if (const auto *memoryStream = dynamic_cast<const MemoryInputStream *>(&stream)) {
+            mData = reinterpret_cast<const uint8_t *>(memoryStream->data());
+            mSize = memoryStream->size();
+            return;
+        }
+
+#ifdef CXXIMG_HAVE_MMAP
+        if (!path.empty() && map(path)) {
+            return;
+        }
+#endif
+
+        stream.seekg(0, std::istream::end);
+        const int64_t size = stream.tellg();
+        stream.seekg(0);
+
+        mBuffer.resize(size);
+        stream.read(reinterpret_cast<char *>(mBuffer.data()), size);
+
+        mData = mBuffer.data();
+        mSize = mBuffer.size();
+    }
+
+    MappedInput(const MappedInput &) = delete;
+    MappedInput &operator=(const MappedInput &) = delete;
+
+    ~MappedInput() {
+#ifdef CXXIMG_HAVE_MMAP
+        if (mMapped) {
+            munmap(const_cast<uint8_t *>(mData), mSize);
+        }
+#endif
+    }
+
+    const uint8_t *data() const noexcept { return mData; }
+    size_t size() const noexcept { return mSize; }
+
+    /// Returns whether the content is memory mapped rather than copied.
+    bool mapped() const noexcept { return mMapped; }
+
+private:
+#ifdef CXXIMG_HAVE_MMAP
+    bool map(const std::string &path) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat status {};
+        void *address = MAP_FAILED;
+        if (fstat(fd, &status) == 0 && status.st_size > 0) {
+            address = mmap(nullptr, status.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+
+        if (address == MAP_FAILED) {
+            return false;
+        }
+
+        mData = static_cast<const uint8_t *>(address);
+        mSize = status.st_size;
+        mMapped = true;
+        return true;
+    }
+#endif
+
+    const uint8_t *mData = nullptr;
+    size_t mSize = 0;
+    bool mMapped = false;
+    std::vector<uint8_t> mBuffer;
+};
+
+} // namespace detail
+
+} // namespace cxximg
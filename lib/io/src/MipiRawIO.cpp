@@ -183,7 +183,7 @@ void MipiRawWriter<PIXEL_PRECISION, RawXPixel, Raw16FromXPixel>::write(const Ima
     // Pack to MIPIRAW
     rawXImage = raw16Image;
 
-    mStream->write(reinterpret_cast<const char *>(packedImage.data()), packedImage.size());
+    stream()->write(reinterpret_cast<const char *>(packedImage.data()), packedImage.size());
 }
 
 template class MipiRawReader<10, Raw10Pixel, Raw16From10Pixel>;
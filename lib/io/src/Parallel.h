@@ -0,0 +1,85 @@
+// Copyright 2023-2025 Emmanuel Chaboud
+//
+/// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cxximg {
+
+namespace detail {
+
+/// Returns the number of threads to use for the given option value, 0 meaning all available cores.
+inline int resolveNumThreads(int numThreads) {
+    if (numThreads > 0) {
+        return numThreads;
+    }
+    return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+/// Calls function(i) for each i in [0, count), using up to numThreads threads including the calling one.
+/// The first exception thrown by a task is rethrown once all the threads are joined.
+template <typename Function>
+void parallelFor(int count, int numThreads, Function &&function) {
+    numThreads = std::min(resolveNumThreads(numThreads), count);
+
+    if (numThreads <= 1) {
+        for (int i = 0; i < count; ++i) {
+            function(i);
+        }
+        return;
+    }
+
+    std::atomic<int> next = 0;
+    std::exception_ptr error;
+    std::mutex errorMutex;
+
+    const auto worker = [&]() {
+        for (int i = next++; i < count; i = next++) {
+            try {
+                function(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(numThreads - 1);
+    for (int i = 1; i < numThreads; ++i) {
+        threads.emplace_back(worker);
+    }
+
+    worker();
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+} // namespace detail
+
+} // namespace cxximg
@@ -182,7 +182,7 @@ void PlainWriter::write(const Imagef &image) const {
 
 template <typename T>
 void PlainWriter::writeImpl(const Image<T> &image) const {
-    mStream->write(reinterpret_cast<const char *>(image.data()), image.size() * sizeof(T));
+    stream()->write(reinterpret_cast<const char *>(image.data()), image.size() * sizeof(T));
 }
 
 } // namespace cxximg
@@ -13,10 +13,17 @@
 // limitations under the License.
 
 #include "PngIO.h"
+#include "Parallel.h"
 
 #include <png.h>
+#include <zlib.h>
 #include <loguru.hpp>
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+
 using namespace std::string_literals;
 
 namespace cxximg {
@@ -48,6 +55,310 @@ void pngFlushData(png_structp png) {
     stream->flush();
 }
 
+// Size of the deflate window, primed with the end of the previous band so that bands compress as well as a single
+// stream would.
+constexpr int64_t DEFLATE_WINDOW_SIZE = 32768;
+
+// Approximate size of the filtered data deflated by each band.
+constexpr int64_t DEFLATE_BAND_SIZE = 1024 * 1024;
+
+/// Returns the given row in PNG byte order, that is big endian for 16 bits samples.
+template <typename T>
+const uint8_t *pngRow(const Image<T> &image, int y, std::vector<uint8_t> &scratch) {
+    const auto *row = reinterpret_cast<const uint8_t *>(image.buffer(0, y));
+    if constexpr (sizeof(T) == 1) {
+        return row;
+    } else {
+        for (size_t i = 0; i < scratch.size(); i += 2) {
+            scratch[i] = row[i + 1];
+            scratch[i + 1] = row[i];
+        }
+        return scratch.data();
+    }
+}
+
+uint8_t paethPredictor(int a, int b, int c) {
+    const int p = a + b - c;
+    const int pa = std::abs(p - a);
+    const int pb = std::abs(p - b);
+    const int pc = std::abs(p - c);
+
+    if (pa <= pb && pa <= pc) {
+        return a;
+    }
+    return pb <= pc ? b : c;
+}
+
+/// Writes the filter type then the filtered row into output.
+void filterRow(
+        int filterType, const uint8_t *row, const uint8_t *previous, int64_t rowBytes, int bpp, uint8_t *output) {
+    output[0] = filterType;
+    uint8_t *residuals = output + 1;
+
+    // The first pixel has no left neighbour, which is equivalent to a zero one
+    switch (filterType) {
+        case PNG_FILTER_VALUE_NONE:
+            std::memcpy(residuals, row, rowBytes);
+            break;
+        case PNG_FILTER_VALUE_SUB:
+            std::memcpy(residuals, row, bpp);
+            for (int64_t i = bpp; i < rowBytes; ++i) {
+                residuals[i] = row[i] - row[i - bpp];
+            }
+            break;
+        case PNG_FILTER_VALUE_UP:
+            for (int64_t i = 0; i < rowBytes; ++i) {
+                residuals[i] = row[i] - previous[i];
+            }
+            break;
+        case PNG_FILTER_VALUE_AVG:
+            for (int i = 0; i < bpp; ++i) {
+                residuals[i] = row[i] - (previous[i] >> 1);
+            }
+            for (int64_t i = bpp; i < rowBytes; ++i) {
+                residuals[i] = row[i] - ((row[i - bpp] + previous[i]) >> 1);
+            }
+            break;
+        default:
+            for (int i = 0; i < bpp; ++i) {
+                residuals[i] = row[i] - previous[i];
+            }
+            for (int64_t i = bpp; i < rowBytes; ++i) {
+                residuals[i] = row[i] - paethPredictor(row[i - bpp], previous[i], previous[i - bpp]);
+            }
+            break;
+    }
+}
+
+/// Returns the sum of the absolute residuals of a filtered row, used to choose the best filter.
+int64_t residualSum(const uint8_t *output, int64_t rowBytes) {
+    int64_t sum = 0;
+    for (int64_t i = 1; i <= rowBytes; ++i) {
+        sum += std::abs(static_cast<int8_t>(output[i]));
+    }
+    return sum;
+}
+
+/// Filters a row with the filter type, among the given PNG_FILTER_* mask, minimizing the sum of the absolute
+/// residuals, like the libpng heuristic.
+void filterRowAdaptive(const uint8_t *row,
+                       const uint8_t *previous,
+                       int64_t rowBytes,
+                       int bpp,
+                       int filters,
+                       uint8_t *output,
+                       std::vector<uint8_t> &candidate) {
+    int64_t bestSum = -1;
+
+    for (int filterType = PNG_FILTER_VALUE_NONE; filterType <= PNG_FILTER_VALUE_PAETH; ++filterType) {
+        const int mask = PNG_FILTER_NONE << filterType;
+        if ((filters & mask) == 0) {
+            continue;
+        }
+
+        if (bestSum < 0) {
+            filterRow(filterType, row, previous, rowBytes, bpp, output);
+            if (filters == mask) {
+                return; // single filter, no need to compare
+            }
+            bestSum = residualSum(output, rowBytes);
+            continue;
+        }
+
+        filterRow(filterType, row, previous, rowBytes, bpp, candidate.data());
+        const int64_t sum = residualSum(candidate.data(), rowBytes);
+        if (sum < bestSum) {
+            bestSum = sum;
+            std::memcpy(output, candidate.data(), candidate.size());
+        }
+    }
+}
+
+/// Filtering and deflate settings.
+struct PngSettings final {
+    int filters;  // PNG_FILTER_* mask
+    int level;    // in [1-9]
+    int strategy; // zlib strategy
+};
+
+/// Returns the rows in [y0, y1) filtered with the given settings, each one prefixed by its filter type.
+template <typename T>
+std::vector<uint8_t> filterRows(const Image<T> &image, int y0, int y1, const PngSettings &settings) {
+    const int bpp = image.numPlanes() * sizeof(T);
+    const int64_t rowBytes = static_cast<int64_t>(image.width()) * bpp;
+    const int64_t filteredRowBytes = rowBytes + 1;
+
+    std::vector<uint8_t> filtered((y1 - y0) * filteredRowBytes);
+    std::vector<uint8_t> current(rowBytes);
+    std::vector<uint8_t> previous(rowBytes);
+    std::vector<uint8_t> candidate(filteredRowBytes);
+    const std::vector<uint8_t> zeros(rowBytes, 0);
+
+    const uint8_t *previousRow = y0 > 0 ? pngRow(image, y0 - 1, previous) : zeros.data();
+    for (int y = y0; y < y1; ++y) {
+        const uint8_t *row = pngRow(image, y, current);
+        filterRowAdaptive(
+                row, previousRow, rowBytes, bpp, settings.filters, &filtered[(y - y0) * filteredRowBytes], candidate);
+
+        // Swapping the vectors keeps the buffer pointed to by row alive
+        std::swap(current, previous);
+        previousRow = row;
+    }
+
+    return filtered;
+}
+
+/// Raw deflates the given data, priming the window with the given dictionary. Unless finishing the stream, the output
+/// ends on a byte boundary so that it can be followed by another stream.
+std::vector<uint8_t> deflateData(const uint8_t *data,
+                                 int64_t length,
+                                 const uint8_t *dictionary,
+                                 int64_t dictionarySize,
+                                 const PngSettings &settings,
+                                 bool finish) {
+    z_stream stream{};
+    if (deflateInit2(&stream, settings.level, Z_DEFLATED, -15, 8, settings.strategy) != Z_OK) {
+        throw IOError(MODULE, "Cannot initialize deflate");
+    }
+    std::unique_ptr<z_stream, int (*)(z_streamp)> deflater(&stream, deflateEnd);
+
+    if (dictionarySize > 0) {
+        const int64_t windowSize = std::min(dictionarySize, DEFLATE_WINDOW_SIZE);
+        deflateSetDictionary(&stream, dictionary + dictionarySize - windowSize, windowSize);
+    }
+
+    std::vector<uint8_t> output(deflateBound(&stream, length) + 16);
+
+    stream.next_in = const_cast<uint8_t *>(data);
+    stream.avail_in = length;
+    stream.next_out = output.data();
+    stream.avail_out = output.size();
+
+    const int flush = finish ? Z_FINISH : Z_SYNC_FLUSH;
+    int status = Z_OK;
+    while ((status = deflate(&stream, flush)) == Z_OK && stream.avail_out == 0) {
+        const size_t used = output.size();
+        output.resize(2 * used);
+        stream.next_out = output.data() + used;
+        stream.avail_out = used;
+    }
+
+    if (status != (finish ? Z_STREAM_END : Z_OK) || stream.avail_in != 0) {
+        throw IOError(MODULE, "Deflate failed");
+    }
+
+    output.resize(output.size() - stream.avail_out);
+    return output;
+}
+
+// Number and height of the row bands compressed to choose the automatic settings.
+constexpr int TRIAL_BANDS = 4;
+constexpr int TRIAL_BAND_HEIGHT = 16;
+
+// Maximum size increase accepted for the faster run length encoding.
+constexpr double TRIAL_RLE_TOLERANCE = 1.05;
+
+/// Returns the filtering and deflate settings of the given profile.
+template <typename T>
+PngSettings pngSettings(const Image<T> &image, ImageWriter::PngProfile profile, int level) {
+    switch (profile) {
+        case ImageWriter::PngProfile::DEFAULT:
+            break;
+
+        case ImageWriter::PngProfile::FAST:
+            return {PNG_FILTER_UP, 1, sizeof(T) == 1 ? Z_FILTERED : Z_RLE};
+
+        case ImageWriter::PngProfile::AUTO: {
+            // 16 bits residuals are too noisy for string matching to pay off
+            if constexpr (sizeof(T) > 1) {
+                return {PNG_FILTER_UP, level, Z_RLE};
+            }
+
+            // Otherwise compress a few bands with both strategies, and keep run length encoding unless it is
+            // noticeably larger, as on synthetic images or photos with repeated patterns
+            const PngSettings rle = {PNG_FILTER_UP, level, Z_RLE};
+            const PngSettings filtered = {PNG_FILTER_PAETH, level, Z_FILTERED};
+
+            const int bandHeight = std::min(image.height(), TRIAL_BAND_HEIGHT);
+            int64_t rleSize = 0;
+            int64_t filteredSize = 0;
+            for (int i = 0; i < TRIAL_BANDS; ++i) {
+                const int y0 = (image.height() - bandHeight) * i / std::max(TRIAL_BANDS - 1, 1);
+                for (const auto *settings : {&rle, &filtered}) {
+                    const std::vector<uint8_t> rows = filterRows(image, y0, y0 + bandHeight, *settings);
+                    const int64_t size = deflateData(rows.data(), rows.size(), nullptr, 0, *settings, true).size();
+                    (settings == &rle ? rleSize : filteredSize) += size;
+                }
+            }
+
+            return rleSize <= filteredSize * TRIAL_RLE_TOLERANCE ? rle : filtered;
+        }
+    }
+
+    return {PNG_ALL_FILTERS, level, Z_FILTERED};
+}
+
+/// Raw deflate stream of a band of rows, ending on a byte boundary unless it is the last one.
+struct DeflatedBand final {
+    std::vector<uint8_t> data;
+    uLong adler = 0;    // Adler-32 checksum of the filtered rows
+    int64_t length = 0; // size of the filtered rows
+};
+
+/// Filters then deflates the rows in [y0, y1), priming the deflate window with the previous filtered rows.
+template <typename T>
+DeflatedBand deflateBand(const Image<T> &image, int y0, int y1, const PngSettings &settings, bool last) {
+    const int64_t filteredRowBytes = static_cast<int64_t>(image.width()) * image.numPlanes() * sizeof(T) + 1;
+
+    // The rows preceding the band are filtered again to get the dictionary
+    const int dictionaryRows = std::min<int64_t>(y0, (DEFLATE_WINDOW_SIZE + filteredRowBytes - 1) / filteredRowBytes);
+    const std::vector<uint8_t> filtered = filterRows(image, y0 - dictionaryRows, y1, settings);
+
+    const int64_t dictionarySize = dictionaryRows * filteredRowBytes;
+    const uint8_t *data = filtered.data() + dictionarySize;
+
+    DeflatedBand band;
+    band.length = static_cast<int64_t>(filtered.size()) - dictionarySize;
+    band.adler = adler32(adler32(0, nullptr, 0), data, band.length);
+    band.data = deflateData(data, band.length, filtered.data(), dictionarySize, settings, last);
+
+    return band;
+}
+
+/// Encodes the image data as a zlib stream made of bands deflated in parallel, pigz-style.
+/// Each band is to be written as an IDAT chunk.
+template <typename T>
+std::vector<DeflatedBand> deflateParallel(const Image<T> &image, const PngSettings &settings, int numThreads) {
+    const int64_t filteredRowBytes = static_cast<int64_t>(image.width()) * image.numPlanes() * sizeof(T) + 1;
+    const int rowsPerBand = std::max<int64_t>(1, DEFLATE_BAND_SIZE / filteredRowBytes);
+    const int numBands = (image.height() + rowsPerBand - 1) / rowsPerBand;
+
+    std::vector<DeflatedBand> bands(numBands);
+    detail::parallelFor(numBands, numThreads, [&](int i) {
+        const int y0 = i * rowsPerBand;
+        const int y1 = std::min(y0 + rowsPerBand, image.height());
+        bands[i] = deflateBand(image, y0, y1, settings, i == numBands - 1);
+    });
+
+    // zlib header, with a 32 KiB window and the compression level flags set by deflate
+    const int level = settings.level;
+    const int levelFlags = level < 2 || settings.strategy >= Z_HUFFMAN_ONLY ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+    const int header = (0x78 << 8) | (levelFlags << 6);
+    const uint8_t headerBytes[] = {0x78, static_cast<uint8_t>((levelFlags << 6) | (31 - header % 31))};
+    bands.front().data.insert(bands.front().data.begin(), std::begin(headerBytes), std::end(headerBytes));
+
+    // zlib trailer, with the Adler-32 checksum of the whole filtered data
+    uLong adler = adler32(0, nullptr, 0);
+    for (const auto &band : bands) {
+        adler = adler32_combine(adler, band.adler, band.length);
+    }
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        bands.back().data.push_back((adler >> shift) & 0xFF);
+    }
+
+    return bands;
+}
+
 } // namespace
 
 void PngReadDeleter::operator()(png_struct *png) {
@@ -89,6 +400,93 @@ static int pixelTypeToColorType(PixelType pixelType) {
     }
 }
 
+void PngWriteDeleter::operator()(png_struct *png) {
+    png_destroy_write_struct(&png, &info);
+}
+
+/// Creates the write structure, then writes all chunks up to (but not including) the first IDAT.
+static PngWritePtr startWrite(std::ostream *stream,
+                              const LayoutDescriptor &layout,
+                              int bitDepth,
+                              const PngSettings &settings) {
+    PngWritePtr png(png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr));
+    png_infop info = png_create_info_struct(png.get());
+
+    png.get_deleter().info = info;
+
+    // setjmp() must be called in every function that calls a PNG-writing libpng function
+    if (setjmp(png_jmpbuf(png.get()))) { // NOLINT(cert-err52-cpp)
+        throw IOError(MODULE, "Writing failed");
+    }
+
+    png_set_write_fn(png.get(), static_cast<png_voidp>(stream), pngWriteData, pngFlushData);
+
+    // set the filters and compression levels
+    png_set_filter(png.get(), PNG_FILTER_TYPE_BASE, settings.filters);
+    png_set_compression_level(png.get(), settings.level);
+    png_set_compression_strategy(png.get(), settings.strategy);
+
+    // set the image parameters appropriately
+    png_set_IHDR(png.get(),
+                 info,
+                 layout.width,
+                 layout.height,
+                 bitDepth,
+                 pixelTypeToColorType(layout.pixelType),
+                 PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_DEFAULT,
+                 PNG_FILTER_TYPE_DEFAULT);
+
+    // write all chunks up to (but not including) first IDAT
+    png_write_info(png.get(), info);
+
+    // set up the transformations: for now, just pack low-bit-depth pixels into bytes (one, two or four pixels per byte)
+    png_set_packing(png.get());
+
+    // set up byte order in 16-bit depth files
+    png_set_swap(png.get());
+
+    return png;
+}
+
+/// Writes the given interleaved rows, following the previously written ones.
+template <typename T>
+static void writeRows(png_structp png, const ImageView<T> &rows) {
+    // setjmp() must be called in every function that calls a PNG-writing libpng function
+    if (setjmp(png_jmpbuf(png))) { // NOLINT(cert-err52-cpp)
+        throw IOError(MODULE, "Writing failed");
+    }
+
+    for (int y = 0; y < rows.height(); ++y) {
+        png_write_row(png, reinterpret_cast<png_const_bytep>(rows.buffer(0, y)));
+    }
+}
+
+/// Writes the image data deflated in parallel as IDAT chunks, then the IEND chunk.
+static void writeChunks(png_structp png, const std::vector<DeflatedBand> &bands) {
+    // setjmp() must be called in every function that calls a PNG-writing libpng function
+    if (setjmp(png_jmpbuf(png))) { // NOLINT(cert-err52-cpp)
+        throw IOError(MODULE, "Writing failed");
+    }
+
+    for (const auto &band : bands) {
+        png_write_chunk(png, reinterpret_cast<png_const_bytep>("IDAT"), band.data.data(), band.data.size());
+    }
+    png_write_chunk(png, reinterpret_cast<png_const_bytep>("IEND"), nullptr, 0);
+}
+
+/// Writes the end of the file, once all rows are written.
+static void endWrite(png_structp png) {
+    // setjmp() must be called in every function that calls a PNG-writing libpng function
+    if (setjmp(png_jmpbuf(png))) { // NOLINT(cert-err52-cpp)
+        throw IOError(MODULE, "Writing failed");
+    }
+
+    // if we had any text or time info to write after the IDATs, second argument would be info_ptr, but we optimize
+    // slightly by sending NULL pointer
+    png_write_end(png, nullptr);
+}
+
 void PngReader::initialize() {
     mPng.reset(png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr));
 
@@ -108,6 +506,7 @@ void PngReader::initialize() {
     uint32_t width = 0, height = 0;
     int bitDepth = 0, colorType = 0;
     png_get_IHDR(png, info, &width, &height, &bitDepth, &colorType, nullptr, nullptr, nullptr);
+    mInterlaced = png_get_interlace_type(png, info) != PNG_INTERLACE_NONE;
 
     // expand palette images to RGB, low-bit-depth grayscale images to 8 bits, and transparency chunks to full alpha
     // channel
@@ -185,6 +584,86 @@ Image<T> PngReader::read() {
     return image;
 }
 
+void PngReader::readRows8u(int bandHeight, const RowCallback<uint8_t> &callback) {
+    LOG_SCOPE_F(INFO, "Read PNG rows (8 bits)");
+    LOG_S(INFO) << "Path: " << path();
+
+    readRows<uint8_t>(bandHeight, callback);
+}
+
+void PngReader::readRows16u(int bandHeight, const RowCallback<uint16_t> &callback) {
+    LOG_SCOPE_F(INFO, "Read PNG rows (16 bits)");
+    LOG_S(INFO) << "Path: " << path();
+
+    readRows<uint16_t>(bandHeight, callback);
+}
+
+template <typename T>
+void PngReader::readRows(int bandHeight, const RowCallback<T> &callback) {
+    validateType<T>();
+    checkBandHeight(bandHeight);
+
+    if (mInterlaced) {
+        // No row is complete before the last interlacing pass
+        return forEachBand(read<T>(), bandHeight, callback);
+    }
+
+    const LayoutDescriptor layout = layoutDescriptor();
+    const LayoutDescriptor bandLayout =
+            LayoutDescriptor::Builder(layout).height(std::min(bandHeight, layout.height)).build();
+
+    // With prefetch, the next band is decoded in the background while the callback processes the current one
+    Image<T> current(bandLayout);
+    Image<T> next = options().prefetch ? Image<T>(bandLayout) : Image<T>();
+
+    readBand(current, bandLayout.height);
+    for (int y = 0; y < layout.height; y += bandHeight) {
+        const int numRows = std::min(bandHeight, layout.height - y);
+        const int nextRows = std::clamp(layout.height - y - bandHeight, 0, bandHeight);
+
+        std::future<void> prefetch;
+        if (options().prefetch && nextRows > 0) {
+            prefetch = std::async(std::launch::async, [&]() { readBand(next, nextRows); });
+        }
+
+        callback(y, current[Rect{0, 0, layout.width, numRows}]);
+
+        if (prefetch.valid()) {
+            prefetch.get();
+            std::swap(current, next);
+        } else if (nextRows > 0) {
+            readBand(current, nextRows);
+        }
+    }
+
+    readEnd();
+}
+
+template <typename T>
+void PngReader::readBand(Image<T> &band, int numRows) {
+    png_structp png = mPng.get();
+
+    // setjmp() must be called in every function that calls a PNG-writing libpng function
+    if (setjmp(png_jmpbuf(png))) { // NOLINT(cert-err52-cpp)
+        throw IOError(MODULE, "Reading failed");
+    }
+
+    for (int y = 0; y < numRows; ++y) {
+        png_read_row(png, reinterpret_cast<png_bytep>(band.buffer(0, y)), nullptr);
+    }
+}
+
+void PngReader::readEnd() {
+    png_structp png = mPng.get();
+
+    // setjmp() must be called in every function that calls a PNG-writing libpng function
+    if (setjmp(png_jmpbuf(png))) { // NOLINT(cert-err52-cpp)
+        throw IOError(MODULE, "Reading failed");
+    }
+
+    png_read_end(png, nullptr);
+}
+
 void PngWriter::write(const Image8u &image) const {
     LOG_SCOPE_F(INFO, "Write PNG (8 bits)");
     LOG_S(INFO) << "Path: " << path();
@@ -206,52 +685,65 @@ void PngWriter::writeImpl(const Image<T> &image) const {
         return writeImpl<T>(image::convertLayout(image, ImageLayout::INTERLEAVED));
     }
 
-    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
-    png_infop info = png_create_info_struct(png);
+    const PngSettings settings = pngSettings(image, options().pngProfile, options().compressionLevel);
 
-    // setjmp() must be called in every function that calls a PNG-writing libpng function
-    if (setjmp(png_jmpbuf(png))) { // NOLINT(cert-err52-cpp)
-        png_destroy_write_struct(&png, &info);
-        throw IOError(MODULE, "Writing failed");
+    // The image data is compressed before libpng is set up, so that worker exceptions do not cross setjmp()
+    std::vector<DeflatedBand> bands;
+    if (options().pngParallel) {
+        bands = deflateParallel(image, settings, options().numThreads);
+    }
+
+    PngWritePtr png = startWrite(stream(), image.layoutDescriptor(), 8 * sizeof(T), settings);
+
+    if (!bands.empty()) {
+        writeChunks(png.get(), bands);
+        return;
     }
 
-    png_set_write_fn(png, static_cast<png_voidp>(mStream), pngWriteData, pngFlushData);
+    writeRows(png.get(), image);
+    endWrite(png.get());
+}
 
-    // set the compression levels
-    png_set_compression_level(png, options().compressionLevel);
+void PngWriter::writeRows8u(const LayoutDescriptor &layout, int bandHeight, const RowSource<uint8_t> &source) const {
+    LOG_SCOPE_F(INFO, "Write PNG rows (8 bits)");
+    LOG_S(INFO) << "Path: " << path();
 
-    // set the image parameters appropriately
-    png_set_IHDR(png,
-                 info,
-                 image.width(),
-                 image.height(),
-                 8 * sizeof(T),
-                 pixelTypeToColorType(image.pixelType()),
-                 PNG_INTERLACE_NONE,
-                 PNG_COMPRESSION_TYPE_DEFAULT,
-                 PNG_FILTER_TYPE_DEFAULT);
+    writeRowsImpl<uint8_t>(layout, bandHeight, source);
+}
 
-    // write all chunks up to (but not including) first IDAT
-    png_write_info(png, info);
+void PngWriter::writeRows16u(const LayoutDescriptor &layout, int bandHeight, const RowSource<uint16_t> &source) const {
+    LOG_SCOPE_F(INFO, "Write PNG rows (16 bits)");
+    LOG_S(INFO) << "Path: " << path();
 
-    // set up the transformations: for now, just pack low-bit-depth pixels into bytes (one, two or four pixels per byte)
-    png_set_packing(png);
+    writeRowsImpl<uint16_t>(layout, bandHeight, source);
+}
 
-    // set up byte order in 16-bit depth files
-    png_set_swap(png);
+template <typename T>
+void PngWriter::writeRowsImpl(const LayoutDescriptor &layout, int bandHeight, const RowSource<T> &source) const {
+    checkBandHeight(bandHeight);
+
+    // Bands are interleaved, as expected by libpng
+    Image<T> band(LayoutDescriptor::Builder(layout.width, std::min(bandHeight, layout.height))
+                          .imageLayout(ImageLayout::INTERLEAVED)
+                          .pixelType(layout.pixelType)
+                          .pixelPrecision(layout.pixelPrecision)
+                          .build());
+
+    PngWritePtr png;
+    for (int y = 0; y < layout.height; y += bandHeight) {
+        ImageView<T> rows = band[Rect{0, 0, layout.width, std::min(bandHeight, layout.height - y)}];
+        source(y, rows);
+
+        if (!png) {
+            // Automatic settings are chosen from the first band
+            const PngSettings settings = pngSettings(band, options().pngProfile, options().compressionLevel);
+            png = startWrite(stream(), layout, 8 * sizeof(T), settings);
+        }
 
-    // and now we just write the whole image; libpng takes care of interlacing for us
-    std::vector<png_bytep> rowPointers(image.height());
-    for (int y = 0; y < image.height(); ++y) {
-        rowPointers[y] = reinterpret_cast<png_bytep>(image.buffer(0, y));
+        writeRows(png.get(), rows);
     }
 
-    png_write_image(png, rowPointers.data());
-
-    // since that's it, we also close out the end of the PNG file now--if we had any text or time info to write after
-    // the IDATs, second argument would be info_ptr, but we optimize slightly by sending NULL pointer:
-    png_write_end(png, nullptr);
-    png_destroy_write_struct(&png, &info);
+    endWrite(png.get());
 }
 
 } // namespace cxximg
@@ -32,6 +32,13 @@ struct PngReadDeleter final {
     void operator()(png_struct *png);
 };
 
+struct PngWriteDeleter final {
+    png_info *info = nullptr;
+    void operator()(png_struct *png);
+};
+
+using PngWritePtr = std::unique_ptr<png_struct, PngWriteDeleter>;
+
 class PngReader final : public ImageReader {
 public:
     static bool accept(const std::string &path, const uint8_t *signature, bool signatureValid) {
@@ -49,11 +56,23 @@ public:
     Image8u read8u() override;
     Image16u read16u() override;
 
+    void readRows8u(int bandHeight, const RowCallback<uint8_t> &callback) override;
+    void readRows16u(int bandHeight, const RowCallback<uint16_t> &callback) override;
+
 private:
     template <typename T>
     Image<T> read();
 
+    template <typename T>
+    void readRows(int bandHeight, const RowCallback<T> &callback);
+
+    template <typename T>
+    void readBand(Image<T> &band, int numRows);
+
+    void readEnd();
+
     std::unique_ptr<png_struct, PngReadDeleter> mPng;
+    bool mInterlaced = false;
 };
 
 class PngWriter final : public ImageWriter {
@@ -70,9 +89,15 @@ public:
     void write(const Image8u &image) const override;
     void write(const Image16u &image) const override;
 
+    void writeRows8u(const LayoutDescriptor &layout, int bandHeight, const RowSource<uint8_t> &source) const override;
+    void writeRows16u(const LayoutDescriptor &layout, int bandHeight, const RowSource<uint16_t> &source) const override;
+
 private:
     template <typename T>
     void writeImpl(const Image<T> &image) const;
+
+    template <typename T>
+    void writeRowsImpl(const LayoutDescriptor &layout, int bandHeight, const RowSource<T> &source) const;
 };
 
 } // namespace cxximg
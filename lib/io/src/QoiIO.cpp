@@ -0,0 +1,277 @@
+// Copyright 2023-2025 Emmanuel Chaboud
+//
+/// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "QoiIO.h"
+#include "MappedInput.h"
+
+#include <loguru.hpp>
+
+#include <algorithm>
+#include <vector>
+
+using namespace std::string_literals;
+
+namespace cxximg {
+
+static const std::string MODULE = "QOI";
+
+namespace {
+
+constexpr int HEADER_SIZE = 14;
+constexpr uint8_t END_MARKER[] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+// Maximum number of pixels allowed by the specification
+constexpr int64_t MAX_PIXELS = 400000000;
+
+constexpr uint8_t OP_INDEX = 0x00; // 00xxxxxx
+constexpr uint8_t OP_DIFF = 0x40;  // 01xxxxxx
+constexpr uint8_t OP_LUMA = 0x80;  // 10xxxxxx
+constexpr uint8_t OP_RUN = 0xC0;   // 11xxxxxx
+constexpr uint8_t OP_RGB = 0xFE;   // 11111110
+constexpr uint8_t OP_RGBA = 0xFF;  // 11111111
+constexpr uint8_t OP_MASK = 0xC0;
+
+constexpr int MAX_RUN = 62;
+
+struct QoiPixel final {
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+    uint8_t a;
+
+    bool operator==(const QoiPixel &other) const noexcept {
+        return r == other.r && g == other.g && b == other.b && a == other.a;
+    }
+    bool operator!=(const QoiPixel &other) const noexcept { return !(*this == other); }
+
+    int hash() const noexcept { return (r * 3 + g * 5 + b * 7 + a * 11) % 64; }
+};
+
+uint32_t readBigEndian32(const uint8_t *data) {
+    return (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) | (uint32_t(data[2]) << 8) | uint32_t(data[3]);
+}
+
+void writeBigEndian32(uint8_t *data, uint32_t value) {
+    data[0] = value >> 24;
+    data[1] = value >> 16;
+    data[2] = value >> 8;
+    data[3] = value;
+}
+
+} // namespace
+
+QoiReader::QoiReader(const std::string &path, std::istream *stream, const Options &options)
+    : ImageReader(path, stream, options) {}
+
+QoiReader::~QoiReader() = default;
+
+void QoiReader::initialize() {
+    mInput = std::make_unique<detail::MappedInput>(ownsStream() ? path() : ""s, *mStream);
+
+    const uint8_t *data = mInput->data();
+    if (mInput->size() < HEADER_SIZE + sizeof(END_MARKER)) {
+        throw IOError(MODULE, "Failed to read header");
+    }
+    if (!std::equal(std::begin(END_MARKER), std::end(END_MARKER), data + mInput->size() - sizeof(END_MARKER))) {
+        throw IOError(MODULE, "Missing end marker");
+    }
+
+    const uint32_t width = readBigEndian32(data + 4);
+    const uint32_t height = readBigEndian32(data + 8);
+    const int channels = data[12];
+
+    if (width == 0 || height == 0 || int64_t(width) * height > MAX_PIXELS) {
+        throw IOError(MODULE, "Invalid image dimensions: " + std::to_string(width) + "x" + std::to_string(height));
+    }
+    if (channels != 3 && channels != 4) {
+        throw IOError(MODULE, "Unsupported number of channels: " + std::to_string(channels));
+    }
+
+    mDescriptor = {LayoutDescriptor::Builder(width, height)
+                           .imageLayout(ImageLayout::INTERLEAVED)
+                           .pixelType(channels == 4 ? PixelType::RGBA : PixelType::RGB)
+                           .pixelPrecision(8)
+                           .build(),
+                   PixelRepresentation::UINT8};
+}
+
+Image8u QoiReader::read8u() {
+    LOG_SCOPE_F(INFO, "Read QOI");
+    LOG_S(INFO) << "Path: " << path();
+
+    Image8u image(layoutDescriptor());
+    const int channels = image.numPlanes();
+
+    const uint8_t *data = mInput->data();
+    const size_t chunksEnd = mInput->size() - sizeof(END_MARKER);
+    size_t p = HEADER_SIZE;
+
+    QoiPixel index[64] = {};
+    QoiPixel px = {0, 0, 0, 255};
+    int run = 0;
+
+    for (int y = 0; y < image.height(); ++y) {
+        uint8_t *row = image.buffer(0, y);
+
+        for (int x = 0; x < image.width(); ++x, row += channels) {
+            if (run > 0) {
+                --run;
+            } else {
+                // The largest chunk is 5 bytes long, and the end marker pads the data by 8 bytes
+                if (p >= chunksEnd) {
+                    throw IOError(MODULE, "Truncated image data");
+                }
+
+                const uint8_t op = data[p++];
+                if (op == OP_RGB) {
+                    px.r = data[p++];
+                    px.g = data[p++];
+                    px.b = data[p++];
+                } else if (op == OP_RGBA) {
+                    px.r = data[p++];
+                    px.g = data[p++];
+                    px.b = data[p++];
+                    px.a = data[p++];
+                } else if ((op & OP_MASK) == OP_INDEX) {
+                    px = index[op];
+                } else if ((op & OP_MASK) == OP_DIFF) {
+                    px.r += ((op >> 4) & 0x03) - 2;
+                    px.g += ((op >> 2) & 0x03) - 2;
+                    px.b += (op & 0x03) - 2;
+                } else if ((op & OP_MASK) == OP_LUMA) {
+                    const uint8_t next = data[p++];
+                    const int dg = (op & 0x3F) - 32;
+                    px.r += dg - 8 + ((next >> 4) & 0x0F);
+                    px.g += dg;
+                    px.b += dg - 8 + (next & 0x0F);
+                } else {
+                    run = op & 0x3F;
+                }
+
+                index[px.hash()] = px;
+            }
+
+            row[0] = px.r;
+            row[1] = px.g;
+            row[2] = px.b;
+            if (channels == 4) {
+                row[3] = px.a;
+            }
+        }
+    }
+
+    return image;
+}
+
+void QoiWriter::write(const Image8u &image) const {
+    LOG_SCOPE_F(INFO, "Write QOI");
+    LOG_S(INFO) << "Path: " << path();
+
+    if (image.imageLayout() != ImageLayout::INTERLEAVED && image.numPlanes() > 1) {
+        // Planar to interleaved conversion
+        return write(image::convertLayout(image, ImageLayout::INTERLEAVED));
+    }
+
+    const int channels = image.numPlanes();
+    if (channels != 3 && channels != 4) {
+        throw IOError(MODULE, "Unsupported pixel type: "s + toString(image.pixelType()));
+    }
+
+    // Worst case is one tag byte per pixel in addition to the pixel values
+    std::vector<uint8_t> data(HEADER_SIZE + int64_t(image.width()) * image.height() * (channels + 1) +
+                              sizeof(END_MARKER));
+
+    data[0] = 'q';
+    data[1] = 'o';
+    data[2] = 'i';
+    data[3] = 'f';
+    writeBigEndian32(&data[4], image.width());
+    writeBigEndian32(&data[8], image.height());
+    data[12] = channels;
+    data[13] = 0; // sRGB with linear alpha
+
+    size_t p = HEADER_SIZE;
+
+    QoiPixel index[64] = {};
+    QoiPixel previous = {0, 0, 0, 255};
+    int run = 0;
+
+    for (int y = 0; y < image.height(); ++y) {
+        const uint8_t *row = image.buffer(0, y);
+
+        for (int x = 0; x < image.width(); ++x, row += channels) {
+            const QoiPixel px = {row[0], row[1], row[2], channels == 4 ? row[3] : previous.a};
+
+            if (px == previous) {
+                if (++run == MAX_RUN) {
+                    data[p++] = OP_RUN | (run - 1);
+                    run = 0;
+                }
+                continue;
+            }
+
+            if (run > 0) {
+                data[p++] = OP_RUN | (run - 1);
+                run = 0;
+            }
+
+            const int hash = px.hash();
+            if (index[hash] == px) {
+                data[p++] = OP_INDEX | hash;
+            } else {
+                index[hash] = px;
+
+                if (px.a == previous.a) {
+                    const int8_t dr = px.r - previous.r;
+                    const int8_t dg = px.g - previous.g;
+                    const int8_t db = px.b - previous.b;
+                    const int8_t drg = dr - dg;
+                    const int8_t dbg = db - dg;
+
+                    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                        data[p++] = OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2);
+                    } else if (drg >= -8 && drg <= 7 && dg >= -32 && dg <= 31 && dbg >= -8 && dbg <= 7) {
+                        data[p++] = OP_LUMA | (dg + 32);
+                        data[p++] = ((drg + 8) << 4) | (dbg + 8);
+                    } else {
+                        data[p++] = OP_RGB;
+                        data[p++] = px.r;
+                        data[p++] = px.g;
+                        data[p++] = px.b;
+                    }
+                } else {
+                    data[p++] = OP_RGBA;
+                    data[p++] = px.r;
+                    data[p++] = px.g;
+                    data[p++] = px.b;
+                    data[p++] = px.a;
+                }
+            }
+
+            previous = px;
+        }
+    }
+
+    if (run > 0) {
+        data[p++] = OP_RUN | (run - 1);
+    }
+
+    for (uint8_t byte : END_MARKER) {
+        data[p++] = byte;
+    }
+
+    stream()->write(reinterpret_cast<const char *>(data.data()), p);
+}
+
+} // namespace cxximg
@@ -0,0 +1,61 @@
+// Copyright 2023-2025 Emmanuel Chaboud
+//
+/// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "cxximg/io/ImageReader.h"
+#include "cxximg/io/ImageWriter.h"
+
+#include "cxximg/util/File.h"
+
+namespace cxximg {
+
+namespace detail {
+class MappedInput;
+} // namespace detail
+
+class QoiReader final : public ImageReader {
+public:
+    static bool accept(const std::string &path, const uint8_t *signature, bool signatureValid) {
+        if (!signatureValid) {
+            return file::extension(path) == "qoi";
+        }
+        return signature[0] == 'q' && signature[1] == 'o' && signature[2] == 'i' && signature[3] == 'f';
+    }
+
+    QoiReader(const std::string &path, std::istream *stream, const Options &options);
+    ~QoiReader() override;
+
+    void initialize() override;
+
+    Image8u read8u() override;
+
+private:
+    std::unique_ptr<detail::MappedInput> mInput; // whole file, decoded from memory
+};
+
+class QoiWriter final : public ImageWriter {
+public:
+    static bool accept(const std::string &path) { return file::extension(path) == "qoi"; }
+
+    using ImageWriter::ImageWriter;
+
+    bool acceptDescriptor(const LayoutDescriptor &descriptor) const override {
+        return descriptor.pixelType == PixelType::RGB || descriptor.pixelType == PixelType::RGBA;
+    }
+
+    void write(const Image8u &image) const override;
+};
+
+} // namespace cxximg
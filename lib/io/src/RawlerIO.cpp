@@ -1,4 +1,5 @@
 #include "RawlerIO.h"
+#include "MappedInput.h"
 
 #include "cxximg/math/ColorSpace.h"
 
@@ -11,32 +12,37 @@ namespace cxximg {
 
 static const std::string MODULE = "RAWLER";
 
+/// Returns the given error message allocated by Rawler, then frees it.
+static std::string takeError(char *errorMsg) {
+    std::string error = errorMsg ? errorMsg : "Unknown error";
+    rawler::free_error(errorMsg);
+    return error;
+}
+
 RawlerReader::RawlerReader(const std::string &path, std::istream *stream, const Options &options)
     : ImageReader(path, stream, options) {
 }
 
-RawlerReader::~RawlerReader() {
-    if (mRawImage) {
-        rawler::free_image(mRawImage);
+/// Decodes the given buffer, throwing on failure.
+static std::shared_ptr<rawler::RawImage> decode(const uint8_t *data, size_t size) {
+    char *errorMsg = nullptr;
+    rawler::RawImage *rawImage = rawler::decode_buffer(data, size, &errorMsg);
+    if (!rawImage) {
+        throw IOError(MODULE, takeError(errorMsg));
     }
+    return std::shared_ptr<rawler::RawImage>(rawImage, rawler::free_image);
 }
 
+RawlerReader::~RawlerReader() = default;
+
 void RawlerReader::initialize() {
-    // Get stream size
-    mStream->seekg(0, std::istream::end);
-    const int64_t fileSize = mStream->tellg();
-    mStream->seekg(0);
+    // Map the file when opened from its path, the input is kept to decode the image data again on later reads
+    mInput = std::make_unique<detail::MappedInput>(ownsStream() ? path() : ""s, *mStream);
 
-    // Read stream content
-    std::vector<uint8_t> data(fileSize);
-    mStream->read(reinterpret_cast<char *>(data.data()), data.size());
-
-    // Decode raw data
-    char *errorMsg = nullptr;
-    mRawImage = rawler::decode_buffer(data.data(), data.size(), &errorMsg);
-    if (!mRawImage) {
-        throw IOError(MODULE, errorMsg);
-    }
+    // Rawler does not report the image dimensions without decoding the image data, its dummy decoding mode only
+    // allocates a 1x1 placeholder. The image is thus fully decoded here, and its data is handed to the first read.
+    mRawImage = decode(mInput->data(), mInput->size());
+    mDataAdopted = false;
 
     if (mRawImage->cpp != 1) {
         throw IOError(MODULE, "Unsupported number of channels: " + std::to_string(mRawImage->cpp));
@@ -85,17 +91,22 @@ template <typename T>
 Image<T> RawlerReader::read() {
     validateType<T>();
 
-    Image<T> image(layoutDescriptor());
-    if (static_cast<int64_t>(mRawImage->data_len) != image.size()) {
+    // Use the data decoded on initialize, then decode again for later reads
+    std::shared_ptr<rawler::RawImage> rawImage = mDataAdopted ? decode(mInput->data(), mInput->size()) : mRawImage;
+
+    // Raw data is packed, without any alignment
+    const LayoutDescriptor layout =
+            LayoutDescriptor::Builder(layoutDescriptor()).widthAlignment(1).heightAlignment(1).sizeAlignment(1).build();
+    if (static_cast<int64_t>(rawImage->data_len) != layout.requiredBufferSize()) {
         throw IOError(MODULE,
-                      "Data length does not match expected buffer size (expected " + std::to_string(image.size()) +
-                              ", got " + std::to_string(mRawImage->data_len) + ")");
+                      "Data length does not match expected buffer size (expected " +
+                              std::to_string(layout.requiredBufferSize()) + ", got " +
+                              std::to_string(rawImage->data_len) + ")");
     }
 
-    // Copy raw data to the image
-    memcpy(image.data(), mRawImage->data_ptr, image.size() * sizeof(T));
-
-    return image;
+    // The image shares ownership of the decoded data, which is released with the last Rawler image reference
+    mDataAdopted = true;
+    return Image<T>::adopted(layout, static_cast<T *>(const_cast<void *>(rawImage->data_ptr)), [rawImage](T *) {});
 }
 
 std::optional<ExifMetadata> RawlerReader::readExif() const {
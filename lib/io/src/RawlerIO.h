@@ -12,6 +12,12 @@ class RawImage;
 
 namespace cxximg {
 
+namespace detail {
+
+class MappedInput;
+
+} // namespace detail
+
 class RawlerReader final : public ImageReader {
 public:
     static bool accept(const std::string &path) {
@@ -36,7 +42,9 @@ private:
     template <typename T>
     Image<T> read();
 
-    rawler::RawImage *mRawImage = nullptr;
+    std::unique_ptr<detail::MappedInput> mInput;
+    std::shared_ptr<rawler::RawImage> mRawImage; // decoded on initialize, its data is adopted by the first read
+    bool mDataAdopted = false;
 };
 
 } // namespace cxximg
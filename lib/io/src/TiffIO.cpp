@@ -14,10 +14,20 @@
 
 #include "TiffIO.h"
 
+#include "cxximg/math/math.h"
+#include "cxximg/util/MemoryStream.h"
+
 #include <tiffrational.h>
 #include <loguru.hpp>
 #include <tiffio.hxx>
 
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+#include <sstream>
+#include <type_traits>
+#include <vector>
+
 using namespace std::string_literals;
 
 namespace cxximg {
@@ -34,27 +44,115 @@ void tiffErrorHandler(const char *module, const char *fmt, va_list ap) {
     LOG_S(WARNING) << module << ": " << loguru::vstrprintf(fmt, ap);
 }
 
+/// libtiff client over a read/write stream, offsets being relative to the beginning of the stream.
+/// Unlike the libtiff C++ output stream, it can read back what has been written, and write BigTIFF.
+class TiffStreamClient final {
+public:
+    explicit TiffStreamClient(std::iostream &io) : mIo(io) {
+        mIo.seekp(0, std::ios::end);
+        mSize = std::max<std::streamoff>(mIo.tellp(), 0);
+    }
+
+    TIFF *open(const char *name, const char *mode) {
+        return TIFFClientOpen(name, mode, this, read, write, seek, close, size, map, unmap);
+    }
+
+private:
+    static tmsize_t read(thandle_t handle, void *data, tmsize_t size) {
+        auto *client = static_cast<TiffStreamClient *>(handle);
+        client->mIo.clear();
+        client->mIo.seekg(client->mPosition);
+        client->mIo.read(static_cast<char *>(data), size);
+
+        const std::streamsize count = client->mIo.gcount();
+        client->mPosition += count;
+        return count;
+    }
+
+    static tmsize_t write(thandle_t handle, void *data, tmsize_t size) {
+        auto *client = static_cast<TiffStreamClient *>(handle);
+        client->mIo.clear();
+
+        // Streams may not be sought past their end, fill the gap explicitly
+        if (client->mPosition > client->mSize) {
+            client->mIo.seekp(client->mSize);
+            const std::vector<char> padding(client->mPosition - client->mSize, 0);
+            client->mIo.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+        } else {
+            client->mIo.seekp(client->mPosition);
+        }
+
+        client->mIo.write(static_cast<const char *>(data), size);
+        if (client->mIo.fail()) {
+            return -1;
+        }
+
+        client->mPosition += size;
+        client->mSize = std::max(client->mSize, client->mPosition);
+        return size;
+    }
+
+    static toff_t seek(thandle_t handle, toff_t offset, int whence) {
+        auto *client = static_cast<TiffStreamClient *>(handle);
+        if (whence == SEEK_SET) {
+            client->mPosition = static_cast<std::streamoff>(offset);
+        } else if (whence == SEEK_CUR) {
+            client->mPosition += static_cast<std::streamoff>(offset);
+        } else if (whence == SEEK_END) {
+            client->mPosition = client->mSize + static_cast<std::streamoff>(offset);
+        }
+        return client->mPosition;
+    }
+
+    static int close(thandle_t handle) {
+        auto *client = static_cast<TiffStreamClient *>(handle);
+        client->mIo.flush();
+        return 0;
+    }
+
+    static toff_t size(thandle_t handle) { return static_cast<TiffStreamClient *>(handle)->mSize; }
+
+    static int map(thandle_t /*handle*/, void ** /*base*/, toff_t * /*size*/) { return 0; }
+
+    static void unmap(thandle_t /*handle*/, void * /*base*/, toff_t /*size*/) {}
+
+    std::iostream &mIo;
+    std::streamoff mPosition = 0;
+    std::streamoff mSize = 0;
+};
+
 } // namespace
 
 void TiffDeleter::operator()(TIFF *tif) const {
     TIFFClose(tif);
 }
 
-static PixelType cfaPatternToPixelType(const uint8_t *cfaPattern) {
-    if (cfaPattern[0] == 0 && cfaPattern[1] == 1) {
-        return PixelType::BAYER_RGGB;
+static PixelType cfaPatternToPixelType(const uint8_t *cfaPattern, bool quadBayer) {
+    // Quad Bayer patterns are 4x4, the second color of the first row being at index 2
+    const uint8_t first = cfaPattern[0];
+    const uint8_t second = cfaPattern[quadBayer ? 2 : 1];
+
+    if (first == 0 && second == 1) {
+        return quadBayer ? PixelType::QUADBAYER_RGGB : PixelType::BAYER_RGGB;
+    }
+    if (first == 1 && second == 0) {
+        return quadBayer ? PixelType::QUADBAYER_GRBG : PixelType::BAYER_GRBG;
     }
-    if (cfaPattern[0] == 1 && cfaPattern[1] == 0) {
-        return PixelType::BAYER_GRBG;
+    if (first == 2 && second == 1) {
+        return quadBayer ? PixelType::QUADBAYER_BGGR : PixelType::BAYER_BGGR;
     }
-    if (cfaPattern[0] == 2 && cfaPattern[1] == 1) {
-        return PixelType::BAYER_BGGR;
+    if (first == 1 && second == 2) {
+        return quadBayer ? PixelType::QUADBAYER_GBRG : PixelType::BAYER_GBRG;
     }
-    if (cfaPattern[0] == 1 && cfaPattern[1] == 2) {
-        return PixelType::BAYER_GBRG;
+    throw IOError(MODULE, "Unsupported CFA pattern: " + std::to_string(first) + " " + std::to_string(second));
+}
+
+/// Returns the number of pixels after which the CFA pattern repeats, 1 for non CFA images.
+static int cfaPeriod(PixelType pixelType) {
+    if (model::isQuadBayerPixelType(pixelType)) {
+        return 4;
     }
-    throw IOError(MODULE,
-                  "Unsupported CFA pattern: " + std::to_string(cfaPattern[0]) + " " + std::to_string(cfaPattern[1]));
+    return model::isBayerPixelType(pixelType) ? 2 : 1;
 }
 
 void TiffReader::initialize() {
@@ -67,6 +165,30 @@ void TiffReader::initialize() {
     }
     TIFF *tif = mTiff.get();
 
+    // Each frame is a full resolution directory, optionally followed by its reduced resolution levels.
+    do {
+        uint32_t subfileType = 0;
+        TIFFGetField(tif, TIFFTAG_SUBFILETYPE, &subfileType);
+        if ((subfileType & FILETYPE_REDUCEDIMAGE) == 0) {
+            mFrameDirectories.push_back(TIFFCurrentDirectory(tif));
+        }
+    } while (TIFFReadDirectory(tif) != 0);
+
+    if (mFrameDirectories.empty()) {
+        throw IOError(MODULE, "No image found");
+    }
+    if (mFrameDirectories.size() > 1) {
+        LOG_S(INFO) << "Frames: " << mFrameDirectories.size();
+    }
+
+    mFrame = describeFrame(0);
+    mDescriptor = {mFrame.layout, mFrame.pixelRepresentation};
+}
+
+TiffReader::Frame TiffReader::describeFrame(int index) {
+    TIFF *tif = mTiff.get();
+    TIFFSetDirectory(tif, mFrameDirectories[index]);
+
     uint32_t width = 0;
     if (TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width) == 0) {
         throw IOError(MODULE, "Failed to get TIFFTAG_IMAGEWIDTH");
@@ -75,6 +197,37 @@ void TiffReader::initialize() {
     if (TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &height) == 0) {
         throw IOError(MODULE, "Failed to get TIFFTAG_IMAGELENGTH");
     }
+
+    // Reduced resolution levels follow the image. Select the smallest one still at least as large as the downscaled
+    // image, so that the full resolution image is not decoded.
+    Frame frame;
+    frame.directory = mFrameDirectories[index];
+    uint32_t levelWidth = width;
+    uint32_t levelHeight = height;
+    while (TIFFReadDirectory(tif) != 0) {
+        uint32_t subfileType = 0;
+        TIFFGetField(tif, TIFFTAG_SUBFILETYPE, &subfileType);
+        if ((subfileType & FILETYPE_REDUCEDIMAGE) == 0) {
+            break;
+        }
+        ++frame.numLevels;
+
+        uint32_t reducedWidth = 0;
+        uint32_t reducedHeight = 0;
+        TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &reducedWidth);
+        TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &reducedHeight);
+        if (reducedWidth > 0 && reducedHeight > 0 && reducedWidth >= width / options().downscale &&
+            reducedHeight >= height / options().downscale) {
+            frame.directory = TIFFCurrentDirectory(tif);
+            levelWidth = reducedWidth;
+            levelHeight = reducedHeight;
+        }
+    }
+    TIFFSetDirectory(tif, frame.directory);
+    if (levelWidth != width) {
+        LOG_S(INFO) << "Reduced resolution level: " << levelWidth << "x" << levelHeight;
+    }
+
     uint16_t samplesPerPixel = 0;
     if (TIFFGetField(tif, TIFFTAG_SAMPLESPERPIXEL, &samplesPerPixel) == 0) {
         throw IOError(MODULE, "Failed to get TIFFTAG_SAMPLESPERPIXEL");
@@ -95,7 +248,7 @@ void TiffReader::initialize() {
         throw IOError(MODULE, "Failed to get TIFFTAG_PHOTOMETRIC");
     }
 
-    LayoutDescriptor::Builder builder = LayoutDescriptor::Builder(width, height);
+    LayoutDescriptor::Builder builder = LayoutDescriptor::Builder(levelWidth, levelHeight);
     const auto &fileInfo = options().fileInfo;
 
     if (samplesPerPixel == 1) {
@@ -105,10 +258,14 @@ void TiffReader::initialize() {
                 builder.pixelType(PixelType::GRAYSCALE);
                 break;
             case PHOTOMETRIC_CFA: {
+                uint16_t *cfaPatternDim = nullptr;
+                const bool quadBayer = TIFFGetField(tif, TIFFTAG_CFAREPEATPATTERNDIM, &cfaPatternDim) != 0 &&
+                                       cfaPatternDim[0] == 4 && cfaPatternDim[1] == 4;
+
                 uint16_t count = 0;
                 uint8_t *cfaPattern = nullptr;
-                if (TIFFGetField(tif, TIFFTAG_CFAPATTERN, &count, &cfaPattern) != 0) {
-                    builder.pixelType(cfaPatternToPixelType(cfaPattern));
+                if (TIFFGetField(tif, TIFFTAG_CFAPATTERN, &count, &cfaPattern) != 0 && count == (quadBayer ? 16 : 4)) {
+                    builder.pixelType(cfaPatternToPixelType(cfaPattern, quadBayer));
                 } else if (fileInfo.pixelType && (model::isBayerPixelType(*fileInfo.pixelType) ||
                                                   model::isQuadBayerPixelType(*fileInfo.pixelType))) {
                     builder.pixelType(*fileInfo.pixelType);
@@ -142,7 +299,7 @@ void TiffReader::initialize() {
         throw IOError(MODULE, "Unsupported samples per pixel: " + std::to_string(samplesPerPixel));
     }
 
-    PixelRepresentation pixelRepresentation = [&]() {
+    frame.pixelRepresentation = [&]() {
         if (sampleFormat == SAMPLEFORMAT_IEEEFP) {
             return PixelRepresentation::FLOAT;
         }
@@ -164,52 +321,255 @@ void TiffReader::initialize() {
         builder.pixelPrecision(*fileInfo.pixelPrecision);
     }
 
-    mDescriptor = {builder.build(), pixelRepresentation};
+    frame.layout = builder.build();
+
+    frame.region = {0, 0, static_cast<int>(levelWidth), static_cast<int>(levelHeight)};
+    if (options().roi) {
+        const Rect &roi = *options().roi;
+        const int x0 = std::max(roi.x, 0);
+        const int y0 = std::max(roi.y, 0);
+        const int x1 = std::min<int>(roi.x + roi.width, width);
+        const int y1 = std::min<int>(roi.y + roi.height, height);
+
+        if (x1 <= x0 || y1 <= y0) {
+            throw IOError(MODULE, "Region of interest does not intersect the image");
+        }
+        // Map the region to the selected level, starting on the CFA period to keep the pattern.
+        const int period = cfaPeriod(frame.layout.pixelType);
+        const int lx0 = static_cast<int64_t>(x0) * levelWidth / width / period * period;
+        const int ly0 = static_cast<int64_t>(y0) * levelHeight / height / period * period;
+        const int lx1 = std::max<int>(lx0 + 1, math::ceilDivision<int64_t>(int64_t(x1) * levelWidth, width));
+        const int ly1 = std::max<int>(ly0 + 1, math::ceilDivision<int64_t>(int64_t(y1) * levelHeight, height));
+        frame.region = {lx0, ly0, lx1 - lx0, ly1 - ly0};
+        frame.layout =
+                LayoutDescriptor::Builder(frame.layout).width(frame.region.width).height(frame.region.height).build();
+    }
+
+    return frame;
+}
+
+void TiffReader::selectFrame(int index) {
+    if (index < 0 || index >= numFrames()) {
+        throw IOError(MODULE, "Invalid frame index: " + std::to_string(index));
+    }
+
+    waitPrefetch();
+    if (mPrefetched && mPrefetched->index == index) {
+        mFrame = mPrefetched->frame;
+    } else {
+        mPrefetched.reset();
+        mFrame = describeFrame(index);
+    }
+
+    mFrameIndex = index;
+    mDescriptor = {mFrame.layout, mFrame.pixelRepresentation};
+}
+
+Rect TiffReader::frameRegion(const Rect &region) const {
+    // Starting on another phase would change the CFA pattern of the decoded image, extend the region instead.
+    const int period = cfaPeriod(mFrame.layout.pixelType);
+    const int x = region.x / period * period;
+    const int y = region.y / period * period;
+    return {mFrame.region.x + x, mFrame.region.y + y, region.width + region.x - x, region.height + region.y - y};
 }
 
 Image8u TiffReader::read8u() {
     LOG_SCOPE_F(INFO, "Read TIFF (8 bits)");
     LOG_S(INFO) << "Path: " << path();
 
-    return read<uint8_t>();
+    return readFrame<uint8_t>();
 }
 
 Image16u TiffReader::read16u() {
     LOG_SCOPE_F(INFO, "Read TIFF (16 bits)");
     LOG_S(INFO) << "Path: " << path();
 
-    return read<uint16_t>();
+    return readFrame<uint16_t>();
 }
 
 Imagef TiffReader::readf() {
     LOG_SCOPE_F(INFO, "Read TIFF (float)");
     LOG_S(INFO) << "Path: " << path();
 
-    return read<float>();
+    return readFrame<float>();
+}
+
+Image8u TiffReader::readRegion8u(const Rect &region) {
+    LOG_SCOPE_F(INFO, "Read TIFF region (8 bits)");
+    LOG_S(INFO) << "Path: " << path();
+
+    validateType<uint8_t>();
+    checkRegion(region);
+    waitPrefetch();
+
+    return decode<uint8_t>(mFrame, frameRegion(region));
+}
+
+Image16u TiffReader::readRegion16u(const Rect &region) {
+    LOG_SCOPE_F(INFO, "Read TIFF region (16 bits)");
+    LOG_S(INFO) << "Path: " << path();
+
+    validateType<uint16_t>();
+    checkRegion(region);
+    waitPrefetch();
+
+    return decode<uint16_t>(mFrame, frameRegion(region));
+}
+
+Imagef TiffReader::readRegionf(const Rect &region) {
+    LOG_SCOPE_F(INFO, "Read TIFF region (float)");
+    LOG_S(INFO) << "Path: " << path();
+
+    validateType<float>();
+    checkRegion(region);
+    waitPrefetch();
+
+    return decode<float>(mFrame, frameRegion(region));
 }
 
 template <typename T>
-Image<T> TiffReader::read() {
+Image<T> TiffReader::readFrame() {
     validateType<T>();
+    waitPrefetch();
+
+    Image<T> image;
+    if (mPrefetched && mPrefetched->index == mFrameIndex && std::holds_alternative<Image<T>>(mPrefetched->image)) {
+        image = std::move(std::get<Image<T>>(mPrefetched->image));
+    } else {
+        image = decode<T>(mFrame, mFrame.region);
+    }
+    mPrefetched.reset();
+
+    // Decode the next frame in the background while this one is being processed.
+    if (options().prefetch && mFrameIndex + 1 < numFrames()) {
+        mPrefetch = std::async(std::launch::async, [this, index = mFrameIndex + 1]() {
+            Prefetched prefetched{index, describeFrame(index), {}};
+            const Frame &frame = prefetched.frame;
+
+            switch (frame.pixelRepresentation) {
+                case PixelRepresentation::UINT8:
+                    prefetched.image = decode<uint8_t>(frame, frame.region);
+                    break;
+                case PixelRepresentation::UINT16:
+                    prefetched.image = decode<uint16_t>(frame, frame.region);
+                    break;
+                case PixelRepresentation::FLOAT:
+                    prefetched.image = decode<float>(frame, frame.region);
+                    break;
+            }
+            return prefetched;
+        });
+    }
+
+    return image;
+}
+
+void TiffReader::waitPrefetch() const {
+    if (!mPrefetch.valid()) {
+        return;
+    }
+
+    try {
+        mPrefetched = mPrefetch.get();
+    } catch (const std::exception &e) {
+        // The frame is decoded again, reporting the error, if it gets selected.
+        LOG_S(WARNING) << "Failed to prefetch frame: " << e.what();
+    }
+}
 
+template <typename T>
+Image<T> TiffReader::decode(const Frame &frame, const Rect &region) {
     TIFF *tif = mTiff.get();
-    const uint32_t nStrips = TIFFNumberOfStrips(tif);
+    TIFFSetDirectory(tif, frame.directory);
 
-    uint32_t rowsPerStrip = 0;
-    if (TIFFGetField(tif, TIFFTAG_ROWSPERSTRIP, &rowsPerStrip) == 0) {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint16_t samplesPerPixel = 1;
+    uint16_t planarConfig = PLANARCONFIG_CONTIG;
+    TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width);
+    TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &height);
+    TIFFGetField(tif, TIFFTAG_SAMPLESPERPIXEL, &samplesPerPixel);
+    TIFFGetField(tif, TIFFTAG_PLANARCONFIG, &planarConfig);
+
+    // Blocks are either tiles or full width strips.
+    const bool tiled = TIFFIsTiled(tif) != 0;
+    uint32_t blockWidth = width;
+    uint32_t blockHeight = height;
+    if (tiled) {
+        if (TIFFGetField(tif, TIFFTAG_TILEWIDTH, &blockWidth) == 0 ||
+            TIFFGetField(tif, TIFFTAG_TILELENGTH, &blockHeight) == 0) {
+            throw IOError(MODULE, "Failed to get TIFFTAG_TILEWIDTH or TIFFTAG_TILELENGTH");
+        }
+    } else if (TIFFGetField(tif, TIFFTAG_ROWSPERSTRIP, &blockHeight) == 0) {
         // TIFFTAG_ROWSPERSTRIP is optional if there is only one strip.
-        if (nStrips > 1) {
+        if (TIFFNumberOfStrips(tif) > 1) {
             throw IOError(MODULE, "Failed to get TIFFTAG_ROWSPERSTRIP");
         }
+        blockHeight = height;
     }
+    blockHeight = std::min(blockHeight, height);
+
+    // With separate planes, each block holds a single sample.
+    const bool separate = planarConfig == PLANARCONFIG_SEPARATE;
+    const int numBlockPlanes = separate ? samplesPerPixel : 1;
+    const int blockSamples = separate ? 1 : samplesPerPixel;
+    const int64_t blockRowStride = static_cast<int64_t>(blockWidth) * blockSamples;
+
+    Image<T> image(LayoutDescriptor::Builder(frame.layout).width(region.width).height(region.height).build());
+
+    const int bx0 = region.x / blockWidth;
+    const int bx1 = (region.x + region.width - 1) / blockWidth;
+    const int by0 = region.y / blockHeight;
+    const int by1 = (region.y + region.height - 1) / blockHeight;
+
+    LOG_S(INFO) << "Decoding " << (bx1 - bx0 + 1) * (by1 - by0 + 1) * numBlockPlanes << (tiled ? " tiles" : " strips");
+
+    mBlockBuffer.resize(static_cast<size_t>(blockRowStride) * blockHeight * sizeof(T));
+    T *block = reinterpret_cast<T *>(mBlockBuffer.data());
+    const tmsize_t blockSize = static_cast<tmsize_t>(mBlockBuffer.size());
+
+    for (int plane = 0; plane < numBlockPlanes; ++plane) {
+        T *dst = image.plane(plane).buffer();
+        const int64_t dstRowStride = image.layoutDescriptor().planes[plane].rowStride;
+
+        for (int by = by0; by <= by1; ++by) {
+            const int y0 = by * blockHeight;
+            const int rows = std::min<int>(blockHeight, height - y0);
+            const int copyY0 = std::max(y0, region.y);
+            const int copyY1 = std::min(y0 + rows, region.y + region.height);
+
+            if (!tiled && region.x == 0 && region.width == static_cast<int>(width) &&
+                dstRowStride == blockRowStride && copyY0 == y0 && copyY1 == y0 + rows) {
+                // The whole strip lies in the region, decode it in place.
+                const tmsize_t size = static_cast<tmsize_t>(rows * blockRowStride * sizeof(T));
+                if (TIFFReadEncodedStrip(
+                            tif, TIFFComputeStrip(tif, y0, plane), dst + (y0 - region.y) * dstRowStride, size) < 0) {
+                    throw IOError(MODULE, "An error occured while decoding");
+                }
+                continue;
+            }
 
-    Image<T> image(layoutDescriptor());
-    T *pStrip = image.data();
+            for (int bx = bx0; bx <= bx1; ++bx) {
+                const int x0 = bx * blockWidth;
+                const int copyX0 = std::max(x0, region.x);
+                const int copyX1 = std::min<int>(x0 + blockWidth, region.x + region.width);
+
+                const tmsize_t decoded =
+                        tiled ? TIFFReadEncodedTile(tif, TIFFComputeTile(tif, x0, y0, 0, plane), block, blockSize)
+                              : TIFFReadEncodedStrip(tif, TIFFComputeStrip(tif, y0, plane), block, blockSize);
+                if (decoded < 0) {
+                    throw IOError(MODULE, "An error occured while decoding");
+                }
 
-    // Copy the TIFF image strips data to cxximg image.
-    const int64_t rowStride = image.width() * image.numPlanes();
-    for (tstrip_t strip = 0; strip < nStrips; ++strip) {
-        TIFFReadEncodedStrip(tif, strip, pStrip + strip * (rowsPerStrip * rowStride), -1);
+                const int64_t rowSize = static_cast<int64_t>(copyX1 - copyX0) * blockSamples;
+                for (int y = copyY0; y < copyY1; ++y) {
+                    const T *src = block + (y - y0) * blockRowStride + (copyX0 - x0) * blockSamples;
+                    std::copy_n(src,
+                                rowSize,
+                                dst + (y - region.y) * dstRowStride + (copyX0 - region.x) * blockSamples);
+                }
+            }
+        }
     }
 
     return image;
@@ -233,6 +593,10 @@ static ExifMetadata::SRational doubleToSRational(double x) {
 std::optional<ExifMetadata> TiffReader::readExif() const {
     TIFF *tif = mTiff.get();
 
+    // EXIF is attached to the full resolution image.
+    waitPrefetch();
+    TIFFSetDirectory(tif, mFrameDirectories[mFrameIndex]);
+
     uint64_t exifOffset = 0;
     if (TIFFGetField(tif, TIFFTAG_EXIFIFD, &exifOffset) == 0) {
         return std::nullopt;
@@ -321,8 +685,6 @@ std::optional<ExifMetadata> TiffReader::readExif() const {
         exif.lensModel = lensModel;
     }
 
-    TIFFSetDirectory(tif, 0); // go back to main directory
-
     return exif;
 }
 
@@ -404,22 +766,9 @@ void TiffWriter::write(const Imagef &image) const {
     writeImpl<float>(image);
 }
 
+/// Sets the image tags of the current directory and writes the image data.
 template <typename T>
-void TiffWriter::writeImpl(const Image<T> &image) const {
-    if (image.imageLayout() == ImageLayout::PLANAR && image.numPlanes() > 1) {
-        // Planar to interleaved conversion
-        return writeImpl<T>(image::convertLayout(image, ImageLayout::INTERLEAVED));
-    }
-
-    TIFFSetWarningHandler(tiffWarningHandler);
-    TIFFSetErrorHandler(tiffErrorHandler);
-
-    TiffPtr tiffPtr(TIFFOpen(path().c_str(), "w")); // TODO: use stream
-    if (!tiffPtr) {
-        throw IOError(MODULE, "Cannot open stream for writing");
-    }
-    TIFF *tif = tiffPtr.get();
-
+static void writeSubfile(TIFF *tif, const Image<T> &image, const ImageWriter::Options &options) {
     TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, image.width());
     TIFFSetField(tif, TIFFTAG_IMAGELENGTH, image.height());
     TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, image.numPlanes());
@@ -429,13 +778,17 @@ void TiffWriter::writeImpl(const Image<T> &image) const {
         TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_IEEEFP);
     }
 
-    if (model::isBayerPixelType(image.pixelType())) {
+    const bool quadBayer = model::isQuadBayerPixelType(image.pixelType());
+    if (model::isBayerPixelType(image.pixelType()) || quadBayer) {
         TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_CFA);
         TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
-        const int16_t cfaPatternDim[] = {2, 2};
+        const int16_t dim = quadBayer ? 4 : 2;
+        const int16_t cfaPatternDim[] = {dim, dim};
         TIFFSetField(tif, TIFFTAG_CFAREPEATPATTERNDIM, cfaPatternDim);
     }
 
+    // Colors of the 2x2 Bayer cells, each cell being repeated 2x2 times in a quad Bayer pattern
+    const char *cfaPattern = nullptr;
     switch (image.pixelType()) {
         case PixelType::GRAYSCALE:
             TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
@@ -443,19 +796,19 @@ void TiffWriter::writeImpl(const Image<T> &image) const {
             break;
         case PixelType::BAYER_BGGR:
         case PixelType::QUADBAYER_BGGR:
-            TIFFSetField(tif, TIFFTAG_CFAPATTERN, 4, "\02\01\01\00");
+            cfaPattern = "\02\01\01\00";
             break;
         case PixelType::BAYER_GBRG:
         case PixelType::QUADBAYER_GBRG:
-            TIFFSetField(tif, TIFFTAG_CFAPATTERN, 4, "\01\02\00\01");
+            cfaPattern = "\01\02\00\01";
             break;
         case PixelType::BAYER_GRBG:
         case PixelType::QUADBAYER_GRBG:
-            TIFFSetField(tif, TIFFTAG_CFAPATTERN, 4, "\01\00\02\01");
+            cfaPattern = "\01\00\02\01";
             break;
         case PixelType::BAYER_RGGB:
         case PixelType::QUADBAYER_RGGB:
-            TIFFSetField(tif, TIFFTAG_CFAPATTERN, 4, "\00\01\01\02");
+            cfaPattern = "\00\01\01\02";
             break;
         case PixelType::RGB:
             // TIFF RGB images should always have a contiguous (RGBRGBRGB ...) not planar (RRR..RGGG..GBBB..B) format.
@@ -467,45 +820,221 @@ void TiffWriter::writeImpl(const Image<T> &image) const {
             throw IOError(MODULE, "Unsupported pixel type: "s + toString(image.pixelType()));
     }
 
-    const uint32_t rowsPerStrip = TIFFDefaultStripSize(tif, -1);
-    TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, rowsPerStrip);
+    if (cfaPattern && quadBayer) {
+        char quadPattern[16];
+        for (int i = 0; i < 16; ++i) {
+            quadPattern[i] = cfaPattern[(i / 8) * 2 + (i % 4) / 2];
+        }
+        TIFFSetField(tif, TIFFTAG_CFAPATTERN, 16, quadPattern);
+    } else if (cfaPattern) {
+        TIFFSetField(tif, TIFFTAG_CFAPATTERN, 4, cfaPattern);
+    }
 
-    if (options().tiffCompression == TiffCompression::DEFLATE) {
-        LOG_S(INFO) << "Compression: zip";
-        TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
-        TIFFSetField(tif, TIFFTAG_ZIPQUALITY, options().compressionLevel);
+    const int tileSize = options.tiffTileSize;
+    uint32_t rowsPerStrip = 0;
+    if (tileSize > 0) {
+        if (tileSize % 16 != 0) {
+            throw IOError(MODULE, "Tile size must be a multiple of 16: " + std::to_string(tileSize));
+        }
+        TIFFSetField(tif, TIFFTAG_TILEWIDTH, tileSize);
+        TIFFSetField(tif, TIFFTAG_TILELENGTH, tileSize);
+    } else {
+        rowsPerStrip = options.tiffRowsPerStrip > 0 ? options.tiffRowsPerStrip : TIFFDefaultStripSize(tif, -1);
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, rowsPerStrip);
+    }
 
+    const auto setPredictor = [&]() {
         if constexpr (std::is_floating_point_v<T>) {
             TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_FLOATINGPOINT);
         } else {
             TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
         }
-    } else {
-        LOG_S(INFO) << "Compression: none";
-        TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
-    }
-
-    const auto &metadata = options().metadata;
-    if (metadata) {
-        populateIfd(tif, metadata->exifMetadata);
+    };
+
+    switch (options.tiffCompression) {
+        case ImageWriter::TiffCompression::DEFLATE:
+            LOG_S(INFO) << "Compression: zip";
+            TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
+            TIFFSetField(tif, TIFFTAG_ZIPQUALITY, options.compressionLevel);
+            setPredictor();
+            break;
+        case ImageWriter::TiffCompression::LZW:
+            LOG_S(INFO) << "Compression: lzw";
+            TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_LZW);
+            setPredictor();
+            break;
+        case ImageWriter::TiffCompression::ZSTD:
+            if (TIFFIsCODECConfigured(COMPRESSION_ZSTD) == 0) {
+                throw IOError(MODULE, "ZSTD compression is not supported by libtiff");
+            }
+            LOG_S(INFO) << "Compression: zstd";
+            TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ZSTD);
+            TIFFSetField(tif, TIFFTAG_ZSTD_LEVEL, options.compressionLevel);
+            setPredictor();
+            break;
+        case ImageWriter::TiffCompression::NONE:
+            LOG_S(INFO) << "Compression: none";
+            TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
+            break;
     }
 
     // Write image data.
-    T *pStrip = image.plane(0).buffer();
+    T *buffer = image.plane(0).buffer();
     const int64_t rowStride = image.layoutDescriptor().planes[0].rowStride;
-    tmsize_t stripSize = TIFFStripSize(tif);
+    const int numPlanes = image.numPlanes();
+
+    if (tileSize > 0) {
+        // Edge tiles are padded with zeros.
+        std::vector<T> tile(static_cast<size_t>(tileSize) * tileSize * numPlanes);
+        const tmsize_t tileBytes = static_cast<tmsize_t>(tile.size() * sizeof(T));
+
+        for (int y0 = 0; y0 < image.height(); y0 += tileSize) {
+            for (int x0 = 0; x0 < image.width(); x0 += tileSize) {
+                const int tileWidth = std::min(tileSize, image.width() - x0);
+                const int tileHeight = std::min(tileSize, image.height() - y0);
+                if (tileWidth < tileSize || tileHeight < tileSize) {
+                    std::fill(tile.begin(), tile.end(), T(0));
+                }
 
-    tstrip_t strip = 0;
-    for (int row = 0; row < image.height(); row += rowsPerStrip) {
-        if (row + static_cast<int>(rowsPerStrip) > image.height()) {
-            stripSize = TIFFVStripSize(tif, image.height() - row);
+                for (int y = 0; y < tileHeight; ++y) {
+                    std::copy_n(buffer + (y0 + y) * rowStride + x0 * numPlanes,
+                                tileWidth * numPlanes,
+                                tile.data() + y * tileSize * numPlanes);
+                }
+                if (TIFFWriteEncodedTile(tif, TIFFComputeTile(tif, x0, y0, 0, 0), tile.data(), tileBytes) < 0) {
+                    throw IOError(MODULE, "An error occured while writing");
+                }
+            }
         }
-        if (TIFFWriteEncodedStrip(tif, strip, pStrip + row * rowStride, stripSize) < 0) {
-            throw IOError(MODULE, "An error occured while writing");
+    } else {
+        tmsize_t stripSize = TIFFStripSize(tif);
+
+        tstrip_t strip = 0;
+        for (int row = 0; row < image.height(); row += rowsPerStrip) {
+            if (row + static_cast<int>(rowsPerStrip) > image.height()) {
+                stripSize = TIFFVStripSize(tif, image.height() - row);
+            }
+            if (TIFFWriteEncodedStrip(tif, strip, buffer + row * rowStride, stripSize) < 0) {
+                throw IOError(MODULE, "An error occured while writing");
+            }
+            ++strip;
         }
-        ++strip;
+    }
+}
+
+/// Returns the image reduced by 2 in both dimensions, averaging 2x2 pixels at the same position in the CFA period.
+template <typename T>
+static Image<T> reduceByTwo(const Image<T> &image) {
+    using Accumulator = std::conditional_t<std::is_floating_point_v<T>, float, uint32_t>;
+
+    // The CFA pattern repeats every 2 pixels in a Bayer mosaic and every 4 pixels in a quad Bayer mosaic, averaging
+    // pixels one period apart keeps the pattern of the reduced image.
+    const int period = cfaPeriod(image.pixelType());
+    const int width = image.width() / (2 * period) * period;
+    const int height = image.height() / (2 * period) * period;
+
+    Image<T> reduced(LayoutDescriptor::Builder(image.layoutDescriptor()).width(width).height(height).build());
+
+    const int numPlanes = image.numPlanes();
+    const T *src = image.plane(0).buffer();
+    T *dst = reduced.plane(0).buffer();
+    const int64_t srcRowStride = image.layoutDescriptor().planes[0].rowStride;
+    const int64_t dstRowStride = reduced.layoutDescriptor().planes[0].rowStride;
+
+    for (int y = 0; y < height; ++y) {
+        const int sy = y / period * 2 * period + y % period;
+        const T *row0 = src + sy * srcRowStride;
+        const T *row1 = row0 + period * srcRowStride;
+
+        for (int x = 0; x < width; ++x) {
+            const int sx = (x / period * 2 * period + x % period) * numPlanes;
+            const int next = period * numPlanes;
+
+            for (int c = 0; c < numPlanes; ++c) {
+                const Accumulator sum = Accumulator(row0[sx + c]) + Accumulator(row0[sx + next + c]) +
+                                        Accumulator(row1[sx + c]) + Accumulator(row1[sx + next + c]);
+                if constexpr (std::is_floating_point_v<T>) {
+                    dst[y * dstRowStride + x * numPlanes + c] = sum / 4;
+                } else {
+                    dst[y * dstRowStride + x * numPlanes + c] = static_cast<T>((sum + 2) / 4);
+                }
+            }
+        }
+    }
+
+    return reduced;
+}
+
+/// Returns an upper estimate of the size of the written samples, including the reduced resolution levels.
+template <typename T>
+static uint64_t estimateFileSize(const Image<T> &image, const ImageWriter::Options &options) {
+    const uint64_t pixelSize = static_cast<uint64_t>(image.numPlanes()) * sizeof(T);
+    uint64_t width = image.width();
+    uint64_t height = image.height();
+    uint64_t size = width * height * pixelSize;
+
+    // Each level is a quarter of the previous one, which adds up to a third of the image at most.
+    for (int i = 0; i < options.tiffPyramidLevels && width > 1 && height > 1; ++i) {
+        width /= 2;
+        height /= 2;
+        size += width * height * pixelSize;
     }
 
+    // Incompressible data grows when compressed: LZW codes are up to 12 bits long for 8 bits samples, deflate and
+    // zstd only add block headers.
+    switch (options.tiffCompression) {
+        case ImageWriter::TiffCompression::NONE:
+            return size;
+        case ImageWriter::TiffCompression::LZW:
+            return size + size / 2;
+        case ImageWriter::TiffCompression::DEFLATE:
+        case ImageWriter::TiffCompression::ZSTD:
+            return size + size / 64;
+    }
+    return size;
+}
+
+template <typename T>
+void TiffWriter::writeImpl(const Image<T> &image) const {
+    if (image.imageLayout() == ImageLayout::PLANAR && image.numPlanes() > 1) {
+        // Planar to interleaved conversion
+        return writeImpl<T>(image::convertLayout(image, ImageLayout::INTERLEAVED));
+    }
+
+    TIFFSetWarningHandler(tiffWarningHandler);
+    TIFFSetErrorHandler(tiffErrorHandler);
+
+    // Classic TIFF offsets are 32 bits, leave some room for directories and metadata.
+    static constexpr uint64_t BIGTIFF_THRESHOLD = 0xF0000000;
+    const bool bigTiff = options().tiffBigTiff || estimateFileSize(image, options()) > BIGTIFF_THRESHOLD;
+    if (bigTiff) {
+        LOG_S(INFO) << "Format: BigTIFF";
+    }
+
+    // libtiff reads back the directories it has written, output streams that cannot be read are written at the end
+    std::ostream *output = stream(std::ios::in | std::ios::out | std::ios::trunc);
+    auto *io = dynamic_cast<std::iostream *>(output);
+
+    VectorStreamBuf buffer;
+    std::iostream bufferStream(&buffer);
+    if (!io) {
+        io = &bufferStream;
+    }
+
+    TiffStreamClient client(*io);
+    TiffPtr tiffPtr(client.open(path().c_str(), bigTiff ? "w8m" : "wm"));
+    if (!tiffPtr) {
+        throw IOError(MODULE, "Cannot open stream for writing");
+    }
+    TIFF *tif = tiffPtr.get();
+
+    const auto &metadata = options().metadata;
+    if (metadata) {
+        populateIfd(tif, metadata->exifMetadata);
+    }
+
+    writeSubfile(tif, image, options());
+
     // Write IFD
     TIFFWriteDirectory(tif);
 
@@ -521,32 +1050,356 @@ void TiffWriter::writeImpl(const Image<T> &image) const {
         TIFFSetField(tif, TIFFTAG_EXIFIFD, exifOffset);
         TIFFWriteDirectory(tif);
     }
+
+    // Write reduced resolution levels, each one computed from the previous one.
+    Image<T> level;
+    for (int i = 0; i < options().tiffPyramidLevels; ++i) {
+        level = reduceByTwo(i == 0 ? image : level);
+        if (level.width() == 0 || level.height() == 0) {
+            break;
+        }
+        LOG_S(INFO) << "Pyramid level " << i + 1 << ": " << level.width() << "x" << level.height();
+
+        TIFFSetField(tif, TIFFTAG_SUBFILETYPE, FILETYPE_REDUCEDIMAGE);
+        writeSubfile(tif, level, options());
+        TIFFWriteDirectory(tif);
+    }
+
+    // Closing writes the last directory
+    tiffPtr.reset();
+    if (io == &bufferStream) {
+        output->write(buffer.vec().data(), static_cast<std::streamsize>(buffer.vec().size()));
+    }
+    if (output->fail()) {
+        throw IOError(MODULE, "Failed to write image");
+    }
 }
 
-void TiffWriter::writeExif(const ExifMetadata &exif) const {
-    TIFFSetWarningHandler(tiffWarningHandler);
-    TIFFSetErrorHandler(tiffErrorHandler);
+namespace {
 
-    TiffPtr tiffPtr(TIFFOpen(path().c_str(), "r+")); // TODO: use stream
-    if (!tiffPtr) {
-        throw IOError(MODULE, "Cannot open stream for writing");
+/// Minimal TIFF directory editor working on a seekable stream.
+/// It updates directories by patching them in place when they fit in their previous slot, or by appending them at the
+/// end of the stream, so that image data is never rewritten. Both classic TIFF and BigTIFF are supported.
+class TiffDirectoryEditor {
+public:
+    struct Entry {
+        uint16_t tag;
+        uint16_t type;
+        uint64_t count;
+        std::vector<uint8_t> data; // value field as stored in the file if raw, value bytes to store otherwise
+        bool raw = false;
+    };
+
+    explicit TiffDirectoryEditor(std::iostream &io) : mIo(io) {
+        mIo.seekg(0);
+        uint8_t byteOrder[2] = {};
+        read(byteOrder, 2);
+        if (byteOrder[0] == 'I' && byteOrder[1] == 'I') {
+            mBigEndian = false;
+        } else if (byteOrder[0] == 'M' && byteOrder[1] == 'M') {
+            mBigEndian = true;
+        } else {
+            throw IOError(MODULE, "Invalid TIFF header");
+        }
+
+        const uint16_t magic = readUInt(2);
+        if (magic == 42) {
+            mBigTiff = false;
+            mFirstIfdOffset = readUInt(4);
+        } else if (magic == 43) {
+            mBigTiff = true;
+            readUInt(4); // offset size and reserved
+            mFirstIfdOffset = readUInt(8);
+        } else {
+            throw IOError(MODULE, "Invalid TIFF magic number: " + std::to_string(magic));
+        }
     }
-    TIFF *tif = tiffPtr.get();
 
-    // Write IFD
-    populateIfd(tif, exif);
-    TIFFRewriteDirectory(tif);
+    uint64_t firstIfdOffset() const { return mFirstIfdOffset; }
 
-    // Write EXIF
-    TIFFCreateEXIFDirectory(tif);
-    populateExif(tif, exif);
+    void setFirstIfdOffset(uint64_t offset) {
+        mIo.seekp(mBigTiff ? 8 : 4);
+        writeUInt(offset, offsetSize());
+        mFirstIfdOffset = offset;
+    }
 
-    uint64_t exifOffset = 0;
-    TIFFWriteCustomDirectory(tif, &exifOffset);
+    /// Reads the directory at the given offset, keeping entry values as raw value fields.
+    std::vector<Entry> readIfd(uint64_t offset, uint64_t *nextOffset) {
+        mIo.seekg(static_cast<std::streamoff>(offset));
+        const uint64_t count = readUInt(mBigTiff ? 8 : 2);
+
+        std::vector<Entry> entries(count);
+        for (Entry &entry : entries) {
+            entry.tag = readUInt(2);
+            entry.type = readUInt(2);
+            entry.count = readUInt(offsetSize());
+            entry.data.resize(offsetSize());
+            read(entry.data.data(), entry.data.size());
+            entry.raw = true;
+        }
 
-    TIFFSetDirectory(tif, 0); // go back to main directory
-    TIFFSetField(tif, TIFFTAG_EXIFIFD, exifOffset);
-    TIFFWriteDirectory(tif);
+        *nextOffset = readUInt(offsetSize());
+        return entries;
+    }
+
+    /// Writes the given directory, in place of the old one if it fits, at the end of the stream otherwise.
+    /// Returns the offset of the written directory.
+    uint64_t writeIfd(std::vector<Entry> entries, uint64_t nextOffset, uint64_t oldOffset, size_t oldCount) {
+        std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.tag < b.tag; });
+
+        // Out-of-line values are appended first.
+        for (Entry &entry : entries) {
+            if (!entry.raw) {
+                if (entry.data.size() > offsetSize()) {
+                    const uint64_t dataOffset = append(entry.data);
+                    entry.data.clear();
+                    putUInt(entry.data, dataOffset, offsetSize());
+                } else {
+                    entry.data.resize(offsetSize(), 0);
+                }
+            }
+        }
+
+        std::vector<uint8_t> ifd;
+        putUInt(ifd, entries.size(), mBigTiff ? 8 : 2);
+        for (const Entry &entry : entries) {
+            putUInt(ifd, entry.tag, 2);
+            putUInt(ifd, entry.type, 2);
+            putUInt(ifd, entry.count, offsetSize());
+            ifd.insert(ifd.end(), entry.data.begin(), entry.data.end());
+        }
+        putUInt(ifd, nextOffset, offsetSize());
+
+        if (oldOffset != 0 && entries.size() <= oldCount) {
+            mIo.seekp(static_cast<std::streamoff>(oldOffset));
+            write(ifd.data(), ifd.size());
+            return oldOffset;
+        }
+        return append(ifd);
+    }
+
+    /// Returns the offset stored in a raw IFD pointer entry.
+    uint64_t pointerValue(const Entry &entry) const {
+        const size_t size = (entry.type == TIFF_LONG8 || entry.type == TIFF_IFD8) ? 8 : 4;
+        return getUInt(entry.data.data(), size);
+    }
+
+    Entry pointerEntry(uint16_t tag, uint64_t offset) const {
+        Entry entry{tag, static_cast<uint16_t>(mBigTiff ? TIFF_IFD8 : TIFF_LONG), 1, {}};
+        putUInt(entry.data, offset, offsetSize());
+        return entry;
+    }
+
+    static Entry asciiEntry(uint16_t tag, const std::string &value) {
+        Entry entry{tag, TIFF_ASCII, value.size() + 1, {value.begin(), value.end()}};
+        entry.data.push_back('\0');
+        return entry;
+    }
+
+    static Entry undefinedEntry(uint16_t tag, const std::vector<uint8_t> &value) {
+        return {tag, TIFF_UNDEFINED, value.size(), value};
+    }
+
+    Entry shortEntry(uint16_t tag, uint16_t value) const {
+        Entry entry{tag, TIFF_SHORT, 1, {}};
+        putUInt(entry.data, value, 2);
+        return entry;
+    }
+
+    Entry rationalEntry(uint16_t tag, const ExifMetadata::Rational &value) const {
+        Entry entry{tag, TIFF_RATIONAL, 1, {}};
+        putUInt(entry.data, value.numerator, 4);
+        putUInt(entry.data, value.denominator, 4);
+        return entry;
+    }
+
+    Entry srationalEntry(uint16_t tag, const ExifMetadata::SRational &value) const {
+        Entry entry{tag, TIFF_SRATIONAL, 1, {}};
+        putUInt(entry.data, static_cast<uint32_t>(value.numerator), 4);
+        putUInt(entry.data, static_cast<uint32_t>(value.denominator), 4);
+        return entry;
+    }
+
+private:
+    size_t offsetSize() const { return mBigTiff ? 8 : 4; }
+
+    void read(uint8_t *data, size_t size) {
+        mIo.read(reinterpret_cast<char *>(data), static_cast<std::streamsize>(size));
+        if (!mIo) {
+            throw IOError(MODULE, "Unexpected end of TIFF stream");
+        }
+    }
+
+    void write(const uint8_t *data, size_t size) {
+        mIo.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(size));
+        if (!mIo) {
+            throw IOError(MODULE, "An error occured while writing");
+        }
+    }
+
+    uint64_t readUInt(size_t size) {
+        uint8_t bytes[8] = {};
+        read(bytes, size);
+        return getUInt(bytes, size);
+    }
+
+    void writeUInt(uint64_t value, size_t size) {
+        std::vector<uint8_t> bytes;
+        putUInt(bytes, value, size);
+        write(bytes.data(), bytes.size());
+    }
+
+    uint64_t getUInt(const uint8_t *bytes, size_t size) const {
+        uint64_t value = 0;
+        for (size_t i = 0; i < size; ++i) {
+            const size_t shift = 8 * (mBigEndian ? size - 1 - i : i);
+            value |= static_cast<uint64_t>(bytes[i]) << shift;
+        }
+        return value;
+    }
+
+    void putUInt(std::vector<uint8_t> &bytes, uint64_t value, size_t size) const {
+        for (size_t i = 0; i < size; ++i) {
+            const size_t shift = 8 * (mBigEndian ? size - 1 - i : i);
+            bytes.push_back(static_cast<uint8_t>(value >> shift));
+        }
+    }
+
+    /// Appends the given bytes at the end of the stream, word-aligned, and returns their offset.
+    uint64_t append(const std::vector<uint8_t> &bytes) {
+        mIo.seekp(0, std::ios::end);
+        uint64_t offset = static_cast<uint64_t>(mIo.tellp());
+        if (offset % 2 != 0) {
+            const uint8_t padding = 0;
+            write(&padding, 1);
+            ++offset;
+        }
+        if (!mBigTiff && offset + bytes.size() > std::numeric_limits<uint32_t>::max()) {
+            throw IOError(MODULE, "Classic TIFF file size limit exceeded");
+        }
+        write(bytes.data(), bytes.size());
+        return offset;
+    }
+
+    std::iostream &mIo;
+    bool mBigEndian = false;
+    bool mBigTiff = false;
+    uint64_t mFirstIfdOffset = 0;
+};
+
+/// Updates the EXIF metadata of the TIFF file held by the given stream.
+void updateExif(std::iostream &io, const ExifMetadata &exif) {
+    TiffDirectoryEditor editor(io);
+
+    uint64_t nextOffset = 0;
+    std::vector<TiffDirectoryEditor::Entry> ifd = editor.readIfd(editor.firstIfdOffset(), &nextOffset);
+    const size_t ifdCount = ifd.size();
+
+    // Main directory tags are merged, EXIF directory is replaced.
+    std::vector<TiffDirectoryEditor::Entry> ifdUpdates;
+    if (exif.imageDescription) {
+        ifdUpdates.push_back(TiffDirectoryEditor::asciiEntry(TIFFTAG_IMAGEDESCRIPTION, *exif.imageDescription));
+    }
+    if (exif.make) {
+        ifdUpdates.push_back(TiffDirectoryEditor::asciiEntry(TIFFTAG_MAKE, *exif.make));
+    }
+    if (exif.model) {
+        ifdUpdates.push_back(TiffDirectoryEditor::asciiEntry(TIFFTAG_MODEL, *exif.model));
+    }
+    if (exif.orientation) {
+        ifdUpdates.push_back(editor.shortEntry(TIFFTAG_ORIENTATION, *exif.orientation));
+    }
+    if (exif.software) {
+        ifdUpdates.push_back(TiffDirectoryEditor::asciiEntry(TIFFTAG_SOFTWARE, *exif.software));
+    }
+
+    std::vector<TiffDirectoryEditor::Entry> exifIfd;
+    exifIfd.push_back(TiffDirectoryEditor::undefinedEntry(EXIFTAG_EXIFVERSION, {'0', '2', '3', '1'}));
+    if (exif.exposureTime) {
+        exifIfd.push_back(editor.rationalEntry(EXIFTAG_EXPOSURETIME, *exif.exposureTime));
+    }
+    if (exif.fNumber) {
+        exifIfd.push_back(editor.rationalEntry(EXIFTAG_FNUMBER, *exif.fNumber));
+    }
+    if (exif.isoSpeedRatings) {
+        exifIfd.push_back(editor.shortEntry(EXIFTAG_ISOSPEEDRATINGS, *exif.isoSpeedRatings));
+    }
+    if (exif.dateTimeOriginal) {
+        exifIfd.push_back(TiffDirectoryEditor::asciiEntry(EXIFTAG_DATETIMEORIGINAL, *exif.dateTimeOriginal));
+    }
+    if (exif.brightnessValue) {
+        exifIfd.push_back(editor.srationalEntry(EXIFTAG_BRIGHTNESSVALUE, *exif.brightnessValue));
+    }
+    if (exif.exposureBiasValue) {
+        exifIfd.push_back(editor.srationalEntry(EXIFTAG_EXPOSUREBIASVALUE, *exif.exposureBiasValue));
+    }
+    if (exif.focalLength) {
+        exifIfd.push_back(editor.rationalEntry(EXIFTAG_FOCALLENGTH, *exif.focalLength));
+    }
+    if (exif.focalLengthIn35mmFilm) {
+        exifIfd.push_back(editor.shortEntry(EXIFTAG_FOCALLENGTHIN35MMFILM, *exif.focalLengthIn35mmFilm));
+    }
+    if (exif.lensMake) {
+        exifIfd.push_back(TiffDirectoryEditor::asciiEntry(EXIFTAG_LENSMAKE, *exif.lensMake));
+    }
+    if (exif.lensModel) {
+        exifIfd.push_back(TiffDirectoryEditor::asciiEntry(EXIFTAG_LENSMODEL, *exif.lensModel));
+    }
+
+    // Reuse the slot of the previous EXIF directory if any.
+    uint64_t oldExifOffset = 0;
+    size_t oldExifCount = 0;
+    const auto exifIt = std::find_if(
+            ifd.begin(), ifd.end(), [](const auto &entry) { return entry.tag == TIFFTAG_EXIFIFD; });
+    if (exifIt != ifd.end()) {
+        oldExifOffset = editor.pointerValue(*exifIt);
+        uint64_t exifNextOffset = 0;
+        oldExifCount = editor.readIfd(oldExifOffset, &exifNextOffset).size();
+    }
+
+    const uint64_t exifOffset = editor.writeIfd(std::move(exifIfd), 0, oldExifOffset, oldExifCount);
+    ifdUpdates.push_back(editor.pointerEntry(TIFFTAG_EXIFIFD, exifOffset));
+
+    for (auto &update : ifdUpdates) {
+        const auto it = std::find_if(
+                ifd.begin(), ifd.end(), [&](const auto &entry) { return entry.tag == update.tag; });
+        if (it != ifd.end()) {
+            *it = std::move(update);
+        } else {
+            ifd.push_back(std::move(update));
+        }
+    }
+
+    const uint64_t ifdOffset = editor.writeIfd(std::move(ifd), nextOffset, editor.firstIfdOffset(), ifdCount);
+    if (ifdOffset != editor.firstIfdOffset()) {
+        editor.setFirstIfdOffset(ifdOffset);
+    }
+}
+
+} // namespace
+
+void TiffWriter::writeExif(const ExifMetadata &exif) const {
+    LOG_SCOPE_F(INFO, "Write TIFF EXIF");
+    LOG_S(INFO) << "Path: " << path();
+
+    std::ostream *output = stream(std::ios::in | std::ios::out);
+
+    if (auto *io = dynamic_cast<std::iostream *>(output)) {
+        updateExif(*io, exif);
+        io->flush();
+    } else if (auto *vectorStream = dynamic_cast<VectorOutputStream *>(output)) {
+        // The vector can be read back and sought through its buffer
+        std::iostream io(vectorStream->rdbuf());
+        updateExif(io, exif);
+    } else if (auto *stringStream = dynamic_cast<std::ostringstream *>(output)) {
+        // The string buffer is write-only, edit a copy of it
+        std::stringstream io(stringStream->str());
+        updateExif(io, exif);
+        stringStream->str(io.str());
+        stringStream->seekp(0, std::ios::end);
+    } else {
+        throw IOError(MODULE, "EXIF update requires a readable output stream");
+    }
 }
 
 } // namespace cxximg
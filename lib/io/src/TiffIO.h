@@ -19,6 +19,10 @@
 
 #include "cxximg/util/File.h"
 
+#include <future>
+#include <variant>
+#include <vector>
+
 // NOLINTBEGIN
 // from tiffio.h
 typedef struct tiff TIFF;
@@ -41,9 +45,11 @@ public:
         }
 
         // Bytes 0-1 should be 'II' or 'MM', 'II' means little endian, 'MM' means big endian, and bytes 2-3 should be
-        // magic number 42.
-        return (signature[0] == 'I' && signature[1] == 'I' && signature[2] == 0x2a && signature[3] == 0) ||
-               (signature[0] == 'M' && signature[1] == 'M' && signature[2] == 0 && signature[3] == 0x2a);
+        // magic number 42, or 43 for BigTIFF.
+        return (signature[0] == 'I' && signature[1] == 'I' && (signature[2] == 0x2a || signature[2] == 0x2b) &&
+                signature[3] == 0) ||
+               (signature[0] == 'M' && signature[1] == 'M' && signature[2] == 0 &&
+                (signature[3] == 0x2a || signature[3] == 0x2b));
     }
 
     using ImageReader::ImageReader;
@@ -54,13 +60,55 @@ public:
     Image16u read16u() override;
     Imagef readf() override;
 
+    int numLevels() const override { return mFrame.numLevels; }
+
+    int numFrames() const override { return static_cast<int>(mFrameDirectories.size()); }
+    void selectFrame(int index) override;
+
+    // Regions of CFA images are extended to start on the CFA period, so that the decoded image keeps the pattern.
+    Image8u readRegion8u(const Rect &region) override;
+    Image16u readRegion16u(const Rect &region) override;
+    Imagef readRegionf(const Rect &region) override;
+
     std::optional<ExifMetadata> readExif() const override;
 
 private:
+    struct Frame final {
+        int directory = 0; // decoded directory, either the frame one or one of its reduced resolution levels
+        int numLevels = 1;
+        Rect region = {}; // decoded region, in coordinates of the decoded level, starting on the CFA period
+        LayoutDescriptor layout = LayoutDescriptor::EMPTY;
+        PixelRepresentation pixelRepresentation = PixelRepresentation::UINT8;
+    };
+
+    struct Prefetched final {
+        int index;
+        Frame frame;
+        std::variant<std::monostate, Image8u, Image16u, Imagef> image;
+    };
+
+    Frame describeFrame(int index);
+
+    /// Maps a region relative to the current frame to the decoded level, starting on the CFA period.
+    Rect frameRegion(const Rect &region) const;
+
     template <typename T>
-    Image<T> read();
+    Image<T> readFrame();
+
+    template <typename T>
+    Image<T> decode(const Frame &frame, const Rect &region);
+
+    void waitPrefetch() const;
 
     TiffPtr mTiff;
+    std::vector<int> mFrameDirectories; // directory of each frame
+    int mFrameIndex = 0;
+    Frame mFrame;
+    std::vector<uint8_t> mBlockBuffer; // decoding buffer, reused between reads
+
+    // Declared last so that a pending prefetch completes before anything else is destroyed.
+    mutable std::optional<Prefetched> mPrefetched;
+    mutable std::future<Prefetched> mPrefetch;
 };
 
 class TiffWriter final : public ImageWriter {
@@ -0,0 +1,116 @@
+// Copyright 2023-2025 Emmanuel Chaboud
+//
+/// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "BayerCodec.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+using namespace cxximg;
+
+// Noisy 12 bits samples, with a few full range outliers to exercise escaped residuals
+static std::vector<uint16_t> makeSamples(int64_t numSamples) {
+    std::vector<uint16_t> samples(numSamples);
+    uint32_t state = 12345;
+    for (int64_t i = 0; i < numSamples; ++i) {
+        state = state * 1664525 + 1013904223;
+        const int noise = static_cast<int>((state >> 24) & 31);
+        samples[i] = (i % 97 == 0) ? static_cast<uint16_t>(state >> 16)
+                                   : static_cast<uint16_t>(2048 + (i % 64) * 16 + noise);
+    }
+    return samples;
+}
+
+static void testRoundTrip(
+        PixelType pixelType, int64_t offset, int64_t rowStride, int64_t firstRow, int64_t numSamples) {
+    const detail::BayerCodec codec(pixelType, offset, rowStride);
+    const std::vector<uint16_t> samples = makeSamples(numSamples);
+
+    const std::vector<uint8_t> data = codec.encode(samples.data(), firstRow, numSamples);
+    EXPECT_LT(data.size(), samples.size() * sizeof(uint16_t));
+
+    std::vector<uint16_t> decoded(numSamples);
+    ASSERT_TRUE(codec.decode(data.data(), data.size(), decoded.data(), firstRow, numSamples));
+    EXPECT_EQ(decoded, samples);
+}
+
+TEST(BayerCodecTest, RoundTripBayer) {
+    for (PixelType pixelType :
+         {PixelType::BAYER_RGGB, PixelType::BAYER_GRBG, PixelType::BAYER_GBRG, PixelType::BAYER_BGGR}) {
+        testRoundTrip(pixelType, 0, 64, 0, 64 * 48);
+    }
+}
+
+TEST(BayerCodecTest, RoundTripQuadBayer) {
+    for (PixelType pixelType : {PixelType::QUADBAYER_RGGB,
+                                PixelType::QUADBAYER_GRBG,
+                                PixelType::QUADBAYER_GBRG,
+                                PixelType::QUADBAYER_BGGR}) {
+        testRoundTrip(pixelType, 0, 64, 0, 64 * 48);
+    }
+}
+
+TEST(BayerCodecTest, RoundTripOddStride) {
+    testRoundTrip(PixelType::BAYER_RGGB, 0, 37, 0, 37 * 29);
+    testRoundTrip(PixelType::QUADBAYER_RGGB, 0, 37, 0, 37 * 29);
+
+    // Incomplete last row
+    testRoundTrip(PixelType::BAYER_GBRG, 0, 41, 0, 41 * 20 + 13);
+    testRoundTrip(PixelType::QUADBAYER_GBRG, 0, 41, 0, 41 * 20 + 13);
+}
+
+TEST(BayerCodecTest, RoundTripBorder) {
+    // Image starting at (3, 5) in the buffer, like an image with borders
+    testRoundTrip(PixelType::BAYER_GRBG, 5 * 45 + 3, 45, 0, 45 * 31);
+    testRoundTrip(PixelType::QUADBAYER_GRBG, 5 * 45 + 3, 45, 0, 45 * 31);
+
+    // Band starting on an odd row of the buffer
+    testRoundTrip(PixelType::BAYER_BGGR, 2 * 33 + 1, 33, 7, 33 * 12);
+    testRoundTrip(PixelType::QUADBAYER_BGGR, 2 * 33 + 1, 33, 7, 33 * 12);
+}
+
+TEST(BayerCodecTest, RoundTripSingleRow) {
+    testRoundTrip(PixelType::BAYER_RGGB, 0, 256, 0, 256);
+    testRoundTrip(PixelType::QUADBAYER_RGGB, 0, 256, 0, 256);
+}
+
+TEST(BayerCodecTest, TruncatedData) {
+    for (PixelType pixelType : {PixelType::BAYER_RGGB, PixelType::QUADBAYER_RGGB}) {
+        const detail::BayerCodec codec(pixelType, 0, 40);
+        const std::vector<uint16_t> samples = makeSamples(40 * 30);
+        const std::vector<uint8_t> data = codec.encode(samples.data(), 0, samples.size());
+
+        std::vector<uint16_t> decoded(samples.size());
+        EXPECT_FALSE(codec.decode(data.data(), 0, decoded.data(), 0, decoded.size()));
+        EXPECT_FALSE(codec.decode(data.data(), data.size() / 2, decoded.data(), 0, decoded.size()));
+        EXPECT_FALSE(codec.decode(data.data(), data.size() - 1, decoded.data(), 0, decoded.size()));
+    }
+}
+
+TEST(BayerCodecTest, CorruptedData) {
+    for (PixelType pixelType : {PixelType::BAYER_RGGB, PixelType::QUADBAYER_RGGB}) {
+        const detail::BayerCodec codec(pixelType, 0, 40);
+        const std::vector<uint16_t> samples = makeSamples(40 * 30);
+        std::vector<uint8_t> data = codec.encode(samples.data(), 0, samples.size());
+
+        // A run of zero bits longer than any coded value
+        std::fill_n(data.begin() + data.size() / 2, 8, 0);
+
+        std::vector<uint16_t> decoded(samples.size());
+        EXPECT_FALSE(codec.decode(data.data(), data.size(), decoded.data(), 0, decoded.size()));
+    }
+}
@@ -0,0 +1,210 @@
+// Copyright 2023-2025 Emmanuel Chaboud
+//
+/// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "CxiIO.h"
+
+#include "cxximg/io/ImageIO.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <sstream>
+
+using namespace cxximg;
+
+// Chunk table following the 216 bytes file header
+static constexpr size_t CHUNK_TABLE_OFFSET = 216;
+
+static Image16u makeImage(const LayoutDescriptor &layout) {
+    Image16u image(layout);
+    uint32_t state = 12345;
+    for (int y = 0; y < image.height(); ++y) {
+        for (int x = 0; x < image.width(); ++x) {
+            state = state * 1664525 + 1013904223;
+            image(x, y, 0) = static_cast<uint16_t>(1024 + (x + y) % 256 * 8 + (state >> 28));
+        }
+    }
+    return image;
+}
+
+static std::string writeImage(const Image16u &image, const ImageWriter::Options &options = {}) {
+    std::ostringstream stream;
+    io::makeWriter("test.cxi", &stream, options)->write(image);
+    return stream.str();
+}
+
+static Image16u readImage(const std::string &data) {
+    std::istringstream stream(data);
+    return io::makeReader("test.cxi", &stream)->read16u();
+}
+
+static void expectSameImage(const Image16u &actual, const Image16u &expected) {
+    ASSERT_EQ(actual.width(), expected.width());
+    ASSERT_EQ(actual.height(), expected.height());
+    EXPECT_EQ(actual.pixelType(), expected.pixelType());
+    EXPECT_EQ(actual.layoutDescriptor().border, expected.layoutDescriptor().border);
+    EXPECT_EQ(actual.layoutDescriptor().planes[0].rowStride, expected.layoutDescriptor().planes[0].rowStride);
+
+    for (int y = 0; y < expected.height(); ++y) {
+        for (int x = 0; x < expected.width(); ++x) {
+            ASSERT_EQ(actual(x, y, 0), expected(x, y, 0)) << "at (" << x << ", " << y << ")";
+        }
+    }
+}
+
+static detail::CxiChunk readChunk(const std::string &data, int index) {
+    detail::CxiChunk chunk{};
+    std::memcpy(&chunk, data.data() + CHUNK_TABLE_OFFSET + index * sizeof(chunk), sizeof(chunk));
+    return chunk;
+}
+
+static void writeChunk(std::string &data, int index, const detail::CxiChunk &chunk) {
+    std::memcpy(data.data() + CHUNK_TABLE_OFFSET + index * sizeof(chunk), &chunk, sizeof(chunk));
+}
+
+TEST(CxiTest, RoundTrip) {
+    const Image16u image = makeImage(LayoutDescriptor::Builder(67, 45).pixelType(PixelType::BAYER_RGGB).build());
+    expectSameImage(readImage(writeImage(image)), image);
+}
+
+TEST(CxiTest, RoundTripBorder) {
+    const Image16u image = makeImage(
+            LayoutDescriptor::Builder(67, 45).pixelType(PixelType::BAYER_GRBG).border(3).widthAlignment(16).build());
+    expectSameImage(readImage(writeImage(image)), image);
+}
+
+TEST(CxiTest, RoundTripBayerCompression) {
+    ImageWriter::Options options;
+    options.cxiCompression = ImageWriter::CxiCompression::BAYER;
+
+    for (PixelType pixelType : {PixelType::BAYER_GBRG, PixelType::QUADBAYER_BGGR}) {
+        // Odd width and a border, over several bands
+        const Image16u image =
+                makeImage(LayoutDescriptor::Builder(1001, 700).pixelType(pixelType).border(5).build());
+        const std::string data = writeImage(image, options);
+
+        EXPECT_LT(data.size(), image.size() * sizeof(uint16_t));
+        expectSameImage(readImage(data), image);
+    }
+}
+
+TEST(CxiTest, RoundTripMetadata) {
+    ImageMetadata metadata;
+    metadata.exifMetadata.make = "Maker";
+    metadata.exifMetadata.exposureTime = ExifMetadata::Rational{1, 120};
+    metadata.shootingParams.totalGain = 4.5f;
+    metadata.calibrationData.blackLevel = 64;
+    metadata.calibrationData.whiteLevel = 4095.5f;
+    metadata.calibrationData.vignetting = DynamicMatrix(3, 4, 0.5f);
+    metadata.calibrationData.colorMatrix = Matrix3{{1.5f, -0.25f, -0.25f}, {-0.5f, 2.0f, -0.5f}, {0.0f, -1.0f, 2.0f}};
+    metadata.cameraControls.whiteBalance = ImageMetadata::WhiteBalance{2.0f, 1.5f};
+    metadata.cameraControls.faceDetection = std::vector<Rectf>{{0.1f, 0.2f, 0.3f, 0.4f}};
+
+    ImageWriter::Options options(metadata);
+    const Image16u image = makeImage(LayoutDescriptor::Builder(16, 16).pixelType(PixelType::BAYER_RGGB).build());
+    const std::string data = writeImage(image, options);
+
+    std::istringstream stream(data);
+    const std::optional<ImageMetadata> result = io::makeReader("test.cxi", &stream)->readMetadata();
+    ASSERT_TRUE(result);
+
+    EXPECT_EQ(result->exifMetadata.make, "Maker");
+    ASSERT_TRUE(result->exifMetadata.exposureTime);
+    EXPECT_EQ(result->exifMetadata.exposureTime->numerator, 1U);
+    EXPECT_EQ(result->exifMetadata.exposureTime->denominator, 120U);
+    EXPECT_EQ(result->shootingParams.totalGain, 4.5f);
+    EXPECT_FALSE(result->shootingParams.sensorGain);
+    EXPECT_EQ(result->calibrationData.blackLevel, (std::variant<int, float>(64)));
+    EXPECT_EQ(result->calibrationData.whiteLevel, (std::variant<int, float>(4095.5f)));
+
+    ASSERT_TRUE(result->calibrationData.vignetting);
+    EXPECT_EQ(result->calibrationData.vignetting->numRows(), 3);
+    EXPECT_EQ(result->calibrationData.vignetting->numCols(), 4);
+    EXPECT_EQ((*result->calibrationData.vignetting)(2, 3), 0.5f);
+
+    ASSERT_TRUE(result->calibrationData.colorMatrix);
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            EXPECT_EQ((*result->calibrationData.colorMatrix)(i, j), (*metadata.calibrationData.colorMatrix)(i, j));
+        }
+    }
+
+    ASSERT_TRUE(result->cameraControls.whiteBalance);
+    EXPECT_EQ(result->cameraControls.whiteBalance->gainR, 2.0f);
+    EXPECT_EQ(result->cameraControls.whiteBalance->gainB, 1.5f);
+
+    ASSERT_TRUE(result->cameraControls.faceDetection);
+    ASSERT_EQ(result->cameraControls.faceDetection->size(), 1U);
+    EXPECT_EQ((*result->cameraControls.faceDetection)[0].width, 0.3f);
+}
+
+TEST(CxiTest, InvalidChunkTable) {
+    const Image16u image = makeImage(LayoutDescriptor::Builder(64, 32).pixelType(PixelType::BAYER_RGGB).build());
+    const std::string data = writeImage(image);
+
+    // Chunk shorter than the buffer
+    std::string corrupted = data;
+    detail::CxiChunk chunk = readChunk(corrupted, 0);
+    chunk.size -= 2;
+    chunk.storedSize -= 2;
+    writeChunk(corrupted, 0, chunk);
+    EXPECT_THROW(readImage(corrupted), IOError);
+
+    // Chunk not starting at the beginning of the buffer
+    corrupted = data;
+    chunk = readChunk(corrupted, 0);
+    chunk.bufferOffset = 2;
+    writeChunk(corrupted, 0, chunk);
+    EXPECT_THROW(readImage(corrupted), IOError);
+
+    // Chunk past the end of the file
+    corrupted = data;
+    chunk = readChunk(corrupted, 0);
+    chunk.fileOffset = static_cast<int64_t>(data.size());
+    writeChunk(corrupted, 0, chunk);
+    EXPECT_THROW(readImage(corrupted), IOError);
+}
+
+TEST(CxiTest, InvalidBayerBands) {
+    ImageWriter::Options options;
+    options.cxiCompression = ImageWriter::CxiCompression::BAYER;
+
+    const Image16u image = makeImage(LayoutDescriptor::Builder(1000, 700).pixelType(PixelType::BAYER_RGGB).build());
+    const std::string data = writeImage(image, options);
+    const detail::CxiChunk first = readChunk(data, 0);
+    const detail::CxiChunk second = readChunk(data, 1);
+
+    // Band boundary not on a row
+    std::string corrupted = data;
+    detail::CxiChunk chunk = first;
+    chunk.size -= 2;
+    writeChunk(corrupted, 0, chunk);
+    chunk = second;
+    chunk.bufferOffset -= 2;
+    chunk.size += 2;
+    writeChunk(corrupted, 1, chunk);
+    EXPECT_THROW(readImage(corrupted), IOError);
+
+    // Truncated band
+    corrupted = data;
+    chunk = first;
+    chunk.storedSize /= 2;
+    writeChunk(corrupted, 0, chunk);
+    EXPECT_THROW(readImage(corrupted), IOError);
+
+    // Corrupted band data
+    corrupted = data;
+    std::memset(corrupted.data() + first.fileOffset + first.storedSize / 2, 0, 8);
+    EXPECT_THROW(readImage(corrupted), IOError);
+}
@@ -0,0 +1,155 @@
+// Copyright 2023-2025 Emmanuel Chaboud
+//
+/// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cxximg/io/ImageIO.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+using namespace cxximg;
+
+// 12 bits samples with some noise, so that lossless JPEG tiles do not compress to nothing
+template <typename T>
+static Image<T> makeImage(const LayoutDescriptor &layout) {
+    Image<T> image(layout);
+    uint32_t state = 12345;
+    for (int y = 0; y < image.height(); ++y) {
+        for (int x = 0; x < image.width(); ++x) {
+            state = state * 1664525 + 1013904223;
+            for (int c = 0; c < image.numPlanes(); ++c) {
+                const int value = (256 + 3 * x + 2 * y + 500 * c + static_cast<int>(state >> 27)) % 4096;
+                image(x, y, c) = std::is_floating_point_v<T> ? static_cast<T>(value / 4096.0f) : static_cast<T>(value);
+            }
+        }
+    }
+    return image;
+}
+
+template <typename T>
+static std::string writeImage(const Image<T> &image, const ImageWriter::Options &options = {}) {
+    std::ostringstream stream;
+    io::makeWriter("test.dng", &stream, options)->write(image);
+    return stream.str();
+}
+
+template <typename T>
+static Image<T> readImage(const std::string &data, int numThreads) {
+    ImageReader::Options options;
+    options.numThreads = numThreads;
+
+    std::istringstream stream(data);
+    const auto reader = io::makeReader("test.dng", &stream, options);
+    if constexpr (std::is_floating_point_v<T>) {
+        return reader->readf();
+    } else {
+        return reader->read16u();
+    }
+}
+
+template <typename T>
+static void expectSameImage(const Image<T> &actual, const Image<T> &expected) {
+    ASSERT_EQ(actual.width(), expected.width());
+    ASSERT_EQ(actual.height(), expected.height());
+    ASSERT_EQ(actual.numPlanes(), expected.numPlanes());
+    EXPECT_EQ(actual.pixelType(), expected.pixelType());
+
+    for (int y = 0; y < expected.height(); ++y) {
+        for (int x = 0; x < expected.width(); ++x) {
+            for (int c = 0; c < expected.numPlanes(); ++c) {
+                if constexpr (std::is_floating_point_v<T>) {
+                    // Floating point data may be stored with a reduced precision
+                    ASSERT_NEAR(actual(x, y, c), expected(x, y, c), 1e-3f)
+                            << "at (" << x << ", " << y << ", " << c << ")";
+                } else {
+                    ASSERT_EQ(actual(x, y, c), expected(x, y, c)) << "at (" << x << ", " << y << ", " << c << ")";
+                }
+            }
+        }
+    }
+}
+
+TEST(DngTest, ReadTiledLosslessJpeg) {
+    // Large enough for the SDK to split the lossless JPEG data into tiles
+    const Image16u image =
+            makeImage<uint16_t>(LayoutDescriptor::Builder(2001, 1501).pixelType(PixelType::BAYER_GRBG).build());
+    const std::string data = writeImage(image);
+
+    for (int numThreads : {1, 4}) {
+        SCOPED_TRACE(std::to_string(numThreads) + " threads");
+
+        // Durations are reported in the test output, e.g. with --gtest_output=xml
+        const auto start = std::chrono::steady_clock::now();
+        const Image16u result = readImage<uint16_t>(data, numThreads);
+        const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+        RecordProperty("read_ms_" + std::to_string(numThreads) + "_threads", std::to_string(duration.count()));
+
+        expectSameImage(result, image);
+    }
+}
+
+TEST(DngTest, ReadTiledLosslessJpegRgb) {
+    const Image16u image = makeImage<uint16_t>(LayoutDescriptor::Builder(1201, 901)
+                                                       .imageLayout(ImageLayout::INTERLEAVED)
+                                                       .pixelType(PixelType::RGB)
+                                                       .build());
+    const std::string data = writeImage(image);
+
+    for (int numThreads : {1, 3, 8}) {
+        SCOPED_TRACE(std::to_string(numThreads) + " threads");
+        expectSameImage(readImage<uint16_t>(data, numThreads), image);
+    }
+}
+
+TEST(DngTest, WriteMultiThreaded) {
+    const Image16u image =
+            makeImage<uint16_t>(LayoutDescriptor::Builder(1501, 1001).pixelType(PixelType::BAYER_RGGB).build());
+
+    for (auto compression : {ImageWriter::DngCompression::LOSSLESS, ImageWriter::DngCompression::NONE}) {
+        SCOPED_TRACE(compression == ImageWriter::DngCompression::LOSSLESS ? "lossless" : "uncompressed");
+        ImageWriter::Options options;
+        options.dngCompression = compression;
+
+        options.numThreads = 4;
+        const auto start = std::chrono::steady_clock::now();
+        const std::string data = writeImage(image, options);
+        const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+        RecordProperty("write_ms_4_threads_" + std::to_string(static_cast<int>(compression)),
+                       std::to_string(duration.count()));
+
+        expectSameImage(readImage<uint16_t>(data, 1), image);
+    }
+}
+
+TEST(DngTest, WriteMultiThreadedBorder) {
+    // The stage 1 image reads the input memory as is, with its border and padding
+    const Image16u image = makeImage<uint16_t>(
+            LayoutDescriptor::Builder(1001, 701).pixelType(PixelType::BAYER_GBRG).border(8).widthAlignment(64).build());
+
+    ImageWriter::Options options;
+    options.numThreads = 4;
+    expectSameImage(readImage<uint16_t>(writeImage(image, options), 4), image);
+}
+
+TEST(DngTest, WriteMultiThreadedFloat) {
+    const Imagef image =
+            makeImage<float>(LayoutDescriptor::Builder(801, 601).pixelType(PixelType::BAYER_BGGR).build());
+
+    ImageWriter::Options options;
+    options.numThreads = 4;
+    expectSameImage(readImage<float>(writeImage(image, options), 4), image);
+}
@@ -0,0 +1,249 @@
+// Copyright 2023-2025 Emmanuel Chaboud
+//
+/// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cxximg/io/ImageIO.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+using namespace cxximg;
+
+static constexpr PixelType PIXEL_TYPES[] = {PixelType::GRAYSCALE, PixelType::RGB, PixelType::RGBA};
+
+// Smooth gradients with noisy areas, so that the filter choice matters
+template <typename T>
+static Image<T> makeImage(int width, int height, PixelType pixelType) {
+    Image<T> image(LayoutDescriptor::Builder(width, height)
+                           .imageLayout(ImageLayout::INTERLEAVED)
+                           .pixelType(pixelType)
+                           .pixelPrecision(8 * sizeof(T))
+                           .build());
+    uint32_t state = 12345;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            state = state * 1664525 + 1013904223;
+            const uint32_t noise = (x / 64 + y / 64) % 2 == 0 ? state >> 26 : 0;
+            for (int c = 0; c < image.numPlanes(); ++c) {
+                image(x, y, c) = static_cast<T>((x * (c + 1) + y * 3) * (sizeof(T) == 1 ? 1 : 97) + noise);
+            }
+        }
+    }
+    return image;
+}
+
+template <typename T>
+static std::string writeImage(const Image<T> &image, const ImageWriter::Options &options = {}) {
+    std::ostringstream stream;
+    io::makeWriter("test.png", &stream, options)->write(image);
+    return stream.str();
+}
+
+template <typename T>
+static Image<T> readImage(const std::string &data, const ImageReader::Options &options = {}) {
+    std::istringstream stream(data);
+    const auto reader = io::makeReader("test.png", &stream, options);
+    if constexpr (std::is_same_v<T, uint8_t>) {
+        return reader->read8u();
+    } else {
+        return reader->read16u();
+    }
+}
+
+template <typename T>
+static void expectSameImage(const Image<T> &actual, const Image<T> &expected) {
+    ASSERT_EQ(actual.width(), expected.width());
+    ASSERT_EQ(actual.height(), expected.height());
+    ASSERT_EQ(actual.pixelType(), expected.pixelType());
+
+    for (int y = 0; y < expected.height(); ++y) {
+        for (int x = 0; x < expected.width(); ++x) {
+            for (int c = 0; c < expected.numPlanes(); ++c) {
+                ASSERT_EQ(actual(x, y, c), expected(x, y, c)) << "at (" << x << ", " << y << ", " << c << ")";
+            }
+        }
+    }
+}
+
+template <typename T>
+static void testParallel(int width, int height) {
+    for (PixelType pixelType : PIXEL_TYPES) {
+        SCOPED_TRACE(toString(pixelType));
+        const Image<T> image = makeImage<T>(width, height, pixelType);
+
+        ImageWriter::Options options;
+        const Image<T> serial = readImage<T>(writeImage(image, options));
+        expectSameImage(serial, image);
+
+        options.pngParallel = true;
+        for (int numThreads : {1, 4}) {
+            SCOPED_TRACE(std::to_string(numThreads) + " threads");
+            options.numThreads = numThreads;
+            expectSameImage(readImage<T>(writeImage(image, options)), serial);
+        }
+    }
+}
+
+template <typename T>
+static void testProfiles() {
+    for (PixelType pixelType : PIXEL_TYPES) {
+        SCOPED_TRACE(toString(pixelType));
+        const Image<T> image = makeImage<T>(301, 203, pixelType);
+
+        for (auto profile :
+             {ImageWriter::PngProfile::DEFAULT, ImageWriter::PngProfile::FAST, ImageWriter::PngProfile::AUTO}) {
+            for (bool parallel : {false, true}) {
+                SCOPED_TRACE(std::to_string(static_cast<int>(profile)) + (parallel ? " parallel" : ""));
+                ImageWriter::Options options;
+                options.pngProfile = profile;
+                options.pngParallel = parallel;
+                options.numThreads = 4;
+                expectSameImage(readImage<T>(writeImage(image, options)), image);
+            }
+        }
+    }
+}
+
+template <typename T>
+static void testReadRows() {
+    const Image<T> image = makeImage<T>(67, 45, PixelType::RGB);
+    const std::string data = writeImage(image);
+
+    for (bool prefetch : {false, true}) {
+        for (int bandHeight : {1, 7, 45, 100}) {
+            SCOPED_TRACE(std::to_string(bandHeight) + (prefetch ? " prefetch" : ""));
+            ImageReader::Options options;
+            options.prefetch = prefetch;
+
+            std::istringstream stream(data);
+            const auto reader = io::makeReader("test.png", &stream, options);
+
+            Image<T> result(image.layoutDescriptor());
+            int nextY = 0;
+            const auto callback = [&](int y, const ImageView<T> &rows) {
+                EXPECT_EQ(y, nextY);
+                EXPECT_EQ(rows.height(), std::min(bandHeight, image.height() - y));
+                for (int row = 0; row < rows.height(); ++row) {
+                    for (int x = 0; x < rows.width(); ++x) {
+                        for (int c = 0; c < rows.numPlanes(); ++c) {
+                            result(x, y + row, c) = rows(x, row, c);
+                        }
+                    }
+                }
+                nextY = y + rows.height();
+            };
+
+            if constexpr (std::is_same_v<T, uint8_t>) {
+                reader->readRows8u(bandHeight, callback);
+            } else {
+                reader->readRows16u(bandHeight, callback);
+            }
+            EXPECT_EQ(nextY, image.height());
+            expectSameImage(result, image);
+        }
+    }
+}
+
+template <typename T>
+static void testWriteRows() {
+    for (PixelType pixelType : PIXEL_TYPES) {
+        SCOPED_TRACE(toString(pixelType));
+        const Image<T> image = makeImage<T>(67, 45, pixelType);
+
+        for (auto profile : {ImageWriter::PngProfile::DEFAULT, ImageWriter::PngProfile::AUTO}) {
+            for (int bandHeight : {1, 8, 100}) {
+                SCOPED_TRACE(bandHeight);
+                ImageWriter::Options options;
+                options.pngProfile = profile;
+
+                int nextY = 0;
+                const auto source = [&](int y, ImageView<T> &rows) {
+                    EXPECT_EQ(y, nextY);
+                    for (int row = 0; row < rows.height(); ++row) {
+                        for (int x = 0; x < rows.width(); ++x) {
+                            for (int c = 0; c < rows.numPlanes(); ++c) {
+                                rows(x, row, c) = image(x, y + row, c);
+                            }
+                        }
+                    }
+                    nextY = y + rows.height();
+                };
+
+                std::ostringstream stream;
+                const auto writer = io::makeWriter("test.png", &stream, options);
+                if constexpr (std::is_same_v<T, uint8_t>) {
+                    writer->writeRows8u(image.layoutDescriptor(), bandHeight, source);
+                } else {
+                    writer->writeRows16u(image.layoutDescriptor(), bandHeight, source);
+                }
+                EXPECT_EQ(nextY, image.height());
+                expectSameImage(readImage<T>(stream.str()), image);
+            }
+        }
+    }
+}
+
+TEST(PngTest, ParallelSingleBand8u) {
+    testParallel<uint8_t>(37, 23);
+}
+
+TEST(PngTest, ParallelSingleBand16u) {
+    testParallel<uint16_t>(37, 23);
+}
+
+TEST(PngTest, ParallelManyBands8u) {
+    // Megabytes of filtered data, deflated by bands of about 1 MB
+    testParallel<uint8_t>(1501, 1001);
+}
+
+TEST(PngTest, ParallelManyBands16u) {
+    testParallel<uint16_t>(1001, 701);
+}
+
+TEST(PngTest, Profiles8u) {
+    testProfiles<uint8_t>();
+}
+
+TEST(PngTest, Profiles16u) {
+    testProfiles<uint16_t>();
+}
+
+TEST(PngTest, ReadRows8u) {
+    testReadRows<uint8_t>();
+}
+
+TEST(PngTest, ReadRows16u) {
+    testReadRows<uint16_t>();
+}
+
+TEST(PngTest, WriteRows8u) {
+    testWriteRows<uint8_t>();
+}
+
+TEST(PngTest, WriteRows16u) {
+    testWriteRows<uint16_t>();
+}
+
+TEST(PngTest, InvalidBandHeight) {
+    const Image8u image = makeImage<uint8_t>(16, 16, PixelType::RGB);
+    std::istringstream stream(writeImage(image));
+    const auto reader = io::makeReader("test.png", &stream);
+    EXPECT_THROW(reader->readRows8u(0, [](int, const ImageView<uint8_t> &) {}), IOError);
+
+    std::ostringstream output;
+    const auto writer = io::makeWriter("test.png", &output);
+    EXPECT_THROW(writer->writeRows8u(image.layoutDescriptor(), 0, [](int, ImageView<uint8_t> &) {}), IOError);
+}
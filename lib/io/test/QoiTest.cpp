@@ -0,0 +1,153 @@
+// Copyright 2023-2025 Emmanuel Chaboud
+//
+/// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cxximg/io/ImageIO.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+using namespace cxximg;
+
+static constexpr size_t HEADER_SIZE = 14;
+static const std::string END_MARKER("\0\0\0\0\0\0\0\1", 8);
+
+static LayoutDescriptor makeLayout(int width, int height, PixelType pixelType) {
+    return LayoutDescriptor::Builder(width, height).imageLayout(ImageLayout::INTERLEAVED).pixelType(pixelType).build();
+}
+
+// Mix of flat areas, smooth gradients, noise and alpha changes, to use all chunk types
+static Image8u makeImage(int width, int height, PixelType pixelType) {
+    Image8u image(makeLayout(width, height, pixelType));
+    uint32_t state = 12345;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            state = state * 1664525 + 1013904223;
+            const bool flat = (x / 8 + y / 8) % 3 == 0;
+            const bool noisy = (x / 8 + y / 8) % 3 == 2;
+            for (int c = 0; c < image.numPlanes(); ++c) {
+                const int noise = noisy ? static_cast<int>(state >> (24 + c)) : 0;
+                const int value = flat ? 40 * c : x + 2 * y + 30 * c + noise;
+                image(x, y, c) = static_cast<uint8_t>(c == 3 ? (flat ? 255 : value % 4 * 60) : value);
+            }
+        }
+    }
+    return image;
+}
+
+static std::string writeImage(const Image8u &image) {
+    std::ostringstream stream;
+    io::makeWriter("test.qoi", &stream)->write(image);
+    return stream.str();
+}
+
+static Image8u readImage(const std::string &data) {
+    std::istringstream stream(data);
+    return io::makeReader("test.qoi", &stream)->read8u();
+}
+
+static void expectSameImage(const Image8u &actual, const Image8u &expected) {
+    ASSERT_EQ(actual.width(), expected.width());
+    ASSERT_EQ(actual.height(), expected.height());
+    ASSERT_EQ(actual.pixelType(), expected.pixelType());
+
+    for (int y = 0; y < expected.height(); ++y) {
+        for (int x = 0; x < expected.width(); ++x) {
+            for (int c = 0; c < expected.numPlanes(); ++c) {
+                ASSERT_EQ(actual(x, y, c), expected(x, y, c)) << "at (" << x << ", " << y << ", " << c << ")";
+            }
+        }
+    }
+}
+
+TEST(QoiTest, SinglePixel) {
+    Image8u image(makeLayout(1, 1, PixelType::RGB));
+    image(0, 0, 0) = 0;
+    image(0, 0, 1) = 0;
+    image(0, 0, 2) = 0;
+
+    // The pixel equals the initial one, it is stored as a run of 1
+    const std::string data = writeImage(image);
+    EXPECT_EQ(data.substr(0, 4), "qoif");
+    EXPECT_EQ(data.substr(HEADER_SIZE), std::string("\xC0", 1) + END_MARKER);
+    expectSameImage(readImage(data), image);
+
+    image(0, 0, 0) = 200;
+    expectSameImage(readImage(writeImage(image)), image);
+}
+
+TEST(QoiTest, RoundTripOddSizes) {
+    for (PixelType pixelType : {PixelType::RGB, PixelType::RGBA}) {
+        for (auto [width, height] : {std::pair{7, 5}, std::pair{1, 33}, std::pair{33, 1}, std::pair{101, 67}}) {
+            SCOPED_TRACE(std::to_string(width) + "x" + std::to_string(height));
+            const Image8u image = makeImage(width, height, pixelType);
+            expectSameImage(readImage(writeImage(image)), image);
+        }
+    }
+}
+
+TEST(QoiTest, LongRuns) {
+    // 62 is the longest run of a single chunk, longer runs are split and may span several rows
+    for (int width : {61, 62, 63, 124, 200}) {
+        SCOPED_TRACE(width);
+        Image8u image(makeLayout(width, 3, PixelType::RGBA));
+        for (int y = 0; y < image.height(); ++y) {
+            for (int x = 0; x < image.width(); ++x) {
+                image(x, y, 0) = 10;
+                image(x, y, 1) = 20;
+                image(x, y, 2) = 30;
+                image(x, y, 3) = x == width / 2 && y == 1 ? 128 : 255;
+            }
+        }
+
+        const std::string data = writeImage(image);
+        EXPECT_LT(data.size(), HEADER_SIZE + 32 + END_MARKER.size());
+        expectSameImage(readImage(data), image);
+    }
+}
+
+TEST(QoiTest, TruncatedStream) {
+    const std::string data = writeImage(makeImage(33, 21, PixelType::RGB));
+
+    EXPECT_THROW(readImage(data.substr(0, HEADER_SIZE)), IOError);
+    EXPECT_THROW(readImage(data.substr(0, data.size() / 2)), IOError);
+
+    // Chunks missing before a valid end marker
+    const std::string chunks = data.substr(0, data.size() - END_MARKER.size());
+    EXPECT_THROW(readImage(chunks.substr(0, chunks.size() / 2) + END_MARKER), IOError);
+    EXPECT_THROW(readImage(chunks.substr(0, chunks.size() - 1) + END_MARKER), IOError);
+}
+
+TEST(QoiTest, MissingEndMarker) {
+    const std::string data = writeImage(makeImage(33, 21, PixelType::RGBA));
+    const std::string chunks = data.substr(0, data.size() - END_MARKER.size());
+
+    EXPECT_THROW(readImage(chunks), IOError);
+    EXPECT_THROW(readImage(chunks + std::string(END_MARKER.size(), '\0')), IOError);
+}
+
+TEST(QoiTest, InvalidHeader) {
+    std::string data = writeImage(makeImage(8, 8, PixelType::RGB));
+
+    std::string corrupted = data;
+    corrupted[12] = 2; // channels
+    EXPECT_THROW(readImage(corrupted), IOError);
+
+    corrupted = data;
+    std::fill_n(corrupted.begin() + 4, 4, '\0'); // width
+    EXPECT_THROW(readImage(corrupted), IOError);
+}
@@ -0,0 +1,109 @@
+// Copyright 2023-2025 Emmanuel Chaboud
+//
+/// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cxximg/io/ImageIO.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+using namespace cxximg;
+
+// Camera raw files are not redistributable, the tested file is given by the CXXIMG_TEST_RAW environment variable
+static std::string rawPath() {
+    const char *path = std::getenv("CXXIMG_TEST_RAW");
+    return path ? path : "";
+}
+
+static void expectSameImage(const Image16u &actual, const Image16u &expected) {
+    ASSERT_EQ(actual.width(), expected.width());
+    ASSERT_EQ(actual.height(), expected.height());
+    ASSERT_EQ(actual.pixelType(), expected.pixelType());
+
+    for (int y = 0; y < expected.height(); ++y) {
+        for (int x = 0; x < expected.width(); ++x) {
+            ASSERT_EQ(actual(x, y, 0), expected(x, y, 0)) << "at (" << x << ", " << y << ")";
+        }
+    }
+}
+
+TEST(RawlerTest, ReadFromPath) {
+    const std::string path = rawPath();
+    if (path.empty()) {
+        GTEST_SKIP() << "CXXIMG_TEST_RAW is not set";
+    }
+
+    const auto reader = io::makeReader(path);
+    const LayoutDescriptor layout = reader->layoutDescriptor();
+
+    // Dimensions are known before reading, and are those of the decoded data
+    EXPECT_GT(layout.width, 1);
+    EXPECT_GT(layout.height, 1);
+    EXPECT_TRUE(model::isBayerPixelType(layout.pixelType));
+
+    const Image16u image = reader->read16u();
+    EXPECT_EQ(image.width(), layout.width);
+    EXPECT_EQ(image.height(), layout.height);
+    EXPECT_EQ(image.pixelType(), layout.pixelType);
+
+    // Later reads decode the data again
+    expectSameImage(reader->read16u(), image);
+
+    // Metadata remains available once the image data has been handed out
+    const auto metadata = reader->readMetadata();
+    ASSERT_TRUE(metadata.has_value());
+    EXPECT_TRUE(metadata->calibrationData.whiteLevel.has_value());
+}
+
+TEST(RawlerTest, ReadFromStream) {
+    const std::string path = rawPath();
+    if (path.empty()) {
+        GTEST_SKIP() << "CXXIMG_TEST_RAW is not set";
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream stream;
+    stream << file.rdbuf();
+
+    const Image16u image = io::makeReader(path, &stream)->read16u();
+    expectSameImage(image, io::makeReader(path)->read16u());
+}
+
+TEST(RawlerTest, DecodeBatch) {
+    const std::string path = rawPath();
+    if (path.empty()) {
+        GTEST_SKIP() << "CXXIMG_TEST_RAW is not set";
+    }
+
+    const LayoutDescriptor layout = io::makeReader(path)->layoutDescriptor();
+
+    // A budget of a single image, so that files are decoded one at a time
+    io::BatchOptions options;
+    options.numThreads = 2;
+    options.memoryBudget = layout.requiredBufferSize() * static_cast<int64_t>(sizeof(uint16_t));
+
+    int count = 0;
+    io::decodeBatch({path, path, path}, [&](io::BatchImage &&result) {
+        ASSERT_FALSE(result.error);
+        const auto *image = std::get_if<Image16u>(&result.image);
+        ASSERT_NE(image, nullptr);
+        EXPECT_EQ(image->width(), layout.width);
+        EXPECT_EQ(image->height(), layout.height);
+        ++count;
+    });
+    EXPECT_EQ(count, 3);
+}
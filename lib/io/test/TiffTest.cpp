@@ -0,0 +1,513 @@
+// Copyright 2023-2025 Emmanuel Chaboud
+//
+/// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cxximg/io/ImageIO.h"
+
+#include <gtest/gtest.h>
+#include <tiffio.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+using namespace cxximg;
+
+namespace fs = std::filesystem;
+
+static Image16u makeImage(int width, int height, PixelType pixelType) {
+    LayoutDescriptor::Builder builder = LayoutDescriptor::Builder(width, height).pixelType(pixelType);
+    if (pixelType == PixelType::RGB) {
+        builder.imageLayout(ImageLayout::INTERLEAVED);
+    }
+    Image16u image(builder.build());
+    for (int y = 0; y < image.height(); ++y) {
+        for (int x = 0; x < image.width(); ++x) {
+            for (int c = 0; c < image.numPlanes(); ++c) {
+                image(x, y, c) = static_cast<uint16_t>(1000 * c + 7 * x + 13 * y);
+            }
+        }
+    }
+    return image;
+}
+
+static void expectSameImage(const Image16u &actual, const Image16u &expected) {
+    ASSERT_EQ(actual.width(), expected.width());
+    ASSERT_EQ(actual.height(), expected.height());
+    ASSERT_EQ(actual.numPlanes(), expected.numPlanes());
+    EXPECT_EQ(actual.pixelType(), expected.pixelType());
+
+    for (int y = 0; y < expected.height(); ++y) {
+        for (int x = 0; x < expected.width(); ++x) {
+            for (int c = 0; c < expected.numPlanes(); ++c) {
+                ASSERT_EQ(actual(x, y, c), expected(x, y, c)) << "at (" << x << ", " << y << ", " << c << ")";
+            }
+        }
+    }
+}
+
+// Checks that the image is the region of the expected image starting at the given position
+static void expectRegion(const Image16u &actual, const Image16u &expected, int x0, int y0, int width, int height) {
+    ASSERT_EQ(actual.width(), width);
+    ASSERT_EQ(actual.height(), height);
+    EXPECT_EQ(actual.pixelType(), expected.pixelType());
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            for (int c = 0; c < expected.numPlanes(); ++c) {
+                ASSERT_EQ(actual(x, y, c), expected(x0 + x, y0 + y, c)) << "at (" << x << ", " << y << ", " << c << ")";
+            }
+        }
+    }
+}
+
+// Reference 2x reduction, averaging the 4 closest pixels of the same CFA color
+static Image16u reduceByTwo(const Image16u &image, int period) {
+    const int width = image.width() / (2 * period) * period;
+    const int height = image.height() / (2 * period) * period;
+    Image16u reduced(LayoutDescriptor::Builder(image.layoutDescriptor()).width(width).height(height).build());
+
+    for (int y = 0; y < height; ++y) {
+        const int sy = y / period * 2 * period + y % period;
+        for (int x = 0; x < width; ++x) {
+            const int sx = x / period * 2 * period + x % period;
+            for (int c = 0; c < image.numPlanes(); ++c) {
+                const int sum = image(sx, sy, c) + image(sx + period, sy, c) + image(sx, sy + period, c) +
+                                image(sx + period, sy + period, c);
+                reduced(x, y, c) = static_cast<uint16_t>((sum + 2) / 4);
+            }
+        }
+    }
+    return reduced;
+}
+
+static std::string writeImage(const Image16u &image, const ImageWriter::Options &options = {}) {
+    std::ostringstream stream;
+    io::makeWriter("test.tif", &stream, options)->write(image);
+    return stream.str();
+}
+
+// Grayscale multi-page TIFF, each page having its own EXIF directory with the maker "Maker <page>". libtiff reads
+// back the directories it links, the file is written on disk.
+static void writePages(const fs::path &path, const std::vector<Image16u> &pages) {
+    TIFF *tif = TIFFOpen(path.string().c_str(), "w");
+    ASSERT_NE(tif, nullptr);
+
+    for (size_t i = 0; i < pages.size(); ++i) {
+        const Image16u &page = pages[i];
+
+        TIFFCreateEXIFDirectory(tif);
+        const uint16_t isoSpeedRatings = static_cast<uint16_t>(100 * (i + 1));
+        TIFFSetField(tif, EXIFTAG_ISOSPEEDRATINGS, 1, &isoSpeedRatings);
+        uint64_t exifOffset = 0;
+        TIFFWriteCustomDirectory(tif, &exifOffset);
+        TIFFCreateDirectory(tif);
+
+        TIFFSetField(tif, TIFFTAG_SUBFILETYPE, FILETYPE_PAGE);
+        TIFFSetField(tif, TIFFTAG_PAGENUMBER, static_cast<uint16_t>(i), static_cast<uint16_t>(pages.size()));
+        TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, static_cast<uint32_t>(page.width()));
+        TIFFSetField(tif, TIFFTAG_IMAGELENGTH, static_cast<uint32_t>(page.height()));
+        TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+        TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 16);
+        TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+        TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, static_cast<uint32_t>(page.height()));
+        TIFFSetField(tif, TIFFTAG_MAKE, ("Maker " + std::to_string(i)).c_str());
+        TIFFSetField(tif, TIFFTAG_EXIFIFD, exifOffset);
+
+        for (int y = 0; y < page.height(); ++y) {
+            std::vector<uint16_t> row(page.width());
+            for (int x = 0; x < page.width(); ++x) {
+                row[x] = page(x, y, 0);
+            }
+            TIFFWriteScanline(tif, row.data(), y, 0);
+        }
+        TIFFWriteDirectory(tif);
+    }
+
+    TIFFClose(tif);
+}
+
+static std::vector<Image16u> makePages() {
+    std::vector<Image16u> pages;
+    pages.push_back(makeImage(16, 8, PixelType::GRAYSCALE));
+    pages.push_back(makeImage(24, 12, PixelType::GRAYSCALE));
+    pages.push_back(makeImage(8, 20, PixelType::GRAYSCALE));
+    return pages;
+}
+
+static void expectPageExif(const std::optional<ExifMetadata> &exif, int page) {
+    ASSERT_TRUE(exif);
+    EXPECT_EQ(exif->make, "Maker " + std::to_string(page));
+    EXPECT_EQ(exif->isoSpeedRatings, 100 * (page + 1));
+}
+
+static std::string readFile(const fs::path &path) {
+    std::ifstream file(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+}
+
+static uint64_t readUInt(const std::string &data, size_t offset, size_t size) {
+    const bool bigEndian = data[0] == 'M';
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; ++i) {
+        const size_t shift = 8 * (bigEndian ? size - 1 - i : i);
+        value |= static_cast<uint64_t>(static_cast<uint8_t>(data[offset + i])) << shift;
+    }
+    return value;
+}
+
+// Offset of the first directory, stored in the TIFF header
+static uint64_t firstIfdOffset(const std::string &data) {
+    const bool bigTiff = readUInt(data, 2, 2) == 43;
+    return bigTiff ? readUInt(data, 8, 8) : readUInt(data, 4, 4);
+}
+
+static std::optional<ExifMetadata> readExif(const std::string &data) {
+    std::istringstream stream(data);
+    return io::makeReader("test.tif", &stream)->readExif();
+}
+
+static Image16u readImage(const std::string &data) {
+    std::istringstream stream(data);
+    return io::makeReader("test.tif", &stream)->read16u();
+}
+
+static ExifMetadata makeExif() {
+    ExifMetadata exif;
+    exif.make = "Maker";
+    exif.model = "Model";
+    exif.software = "Software";
+    exif.exposureTime = ExifMetadata::Rational{1, 100};
+    exif.fNumber = ExifMetadata::Rational{28, 10};
+    exif.isoSpeedRatings = 200;
+    exif.lensModel = "Lens";
+    return exif;
+}
+
+static void expectExif(const std::optional<ExifMetadata> &actual, const ExifMetadata &expected) {
+    ASSERT_TRUE(actual);
+    EXPECT_EQ(actual->make, expected.make);
+    EXPECT_EQ(actual->model, expected.model);
+    EXPECT_EQ(actual->software, expected.software);
+    EXPECT_EQ(actual->isoSpeedRatings, expected.isoSpeedRatings);
+    EXPECT_EQ(actual->lensModel, expected.lensModel);
+    ASSERT_TRUE(actual->exposureTime);
+    EXPECT_FLOAT_EQ(actual->exposureTime->asFloat(), expected.exposureTime->asFloat());
+    ASSERT_TRUE(actual->fNumber);
+    EXPECT_FLOAT_EQ(actual->fNumber->asFloat(), expected.fNumber->asFloat());
+}
+
+// Uncompressed 4x2 8 bits grayscale image, big-endian
+static std::string makeBigEndianTiff() {
+    std::string data = {'M', 'M', 0, 42, 0, 0, 0, 8};
+
+    const auto put = [&](uint64_t value, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            data.push_back(static_cast<char>(value >> (8 * (size - 1 - i))));
+        }
+    };
+    const auto entry = [&](uint16_t tag, uint16_t type, uint32_t value) {
+        put(tag, 2);
+        put(type, 2);
+        put(1, 4);
+        put(value, type == 3 ? 2 : 4);
+        if (type == 3) {
+            put(0, 2);
+        }
+    };
+
+    const uint32_t stripOffset = 8 + 2 + 9 * 12 + 4;
+    put(9, 2);
+    entry(256, 3, 4); // ImageWidth
+    entry(257, 3, 2); // ImageLength
+    entry(258, 3, 8); // BitsPerSample
+    entry(259, 3, 1); // Compression
+    entry(262, 3, 1); // PhotometricInterpretation
+    entry(273, 4, stripOffset);
+    entry(277, 3, 1); // SamplesPerPixel
+    entry(278, 3, 2); // RowsPerStrip
+    entry(279, 4, 8); // StripByteCounts
+    put(0, 4);
+
+    for (int i = 0; i < 8; ++i) {
+        data.push_back(static_cast<char>(10 * i));
+    }
+    return data;
+}
+
+TEST(TiffTest, UpdateExifInPlace) {
+    const fs::path path = fs::temp_directory_path() / "cxximg-tiff-test.tif";
+    const Image16u image = makeImage(40, 30, PixelType::RGB);
+
+    ImageMetadata metadata;
+    metadata.exifMetadata = makeExif();
+    io::makeWriter(path.string(), ImageWriter::Options(metadata))->write(image);
+    const std::string original = readFile(path);
+
+    // Same tags with other values, the main directory keeps its slot
+    ExifMetadata exif = makeExif();
+    exif.make = "Other maker";
+    exif.fNumber = ExifMetadata::Rational{4, 1};
+    io::makeWriter(path.string())->writeExif(exif);
+
+    const std::string updated = readFile(path);
+    fs::remove(path);
+
+    EXPECT_EQ(firstIfdOffset(updated), firstIfdOffset(original));
+    expectExif(readExif(updated), exif);
+    expectSameImage(readImage(updated), image);
+}
+
+TEST(TiffTest, UpdateExifAppendsGrownDirectory) {
+    const Image16u image = makeImage(40, 30, PixelType::RGB);
+
+    std::stringstream stream;
+    const auto writer = io::makeWriter("test.tif", &stream);
+    writer->write(image);
+    const std::string original = stream.str();
+    EXPECT_FALSE(readExif(original));
+
+    // New tags do not fit in the main directory, which is moved to the end
+    writer->writeExif(makeExif());
+
+    const std::string updated = stream.str();
+    EXPECT_NE(firstIfdOffset(updated), firstIfdOffset(original));
+    EXPECT_GT(firstIfdOffset(updated), firstIfdOffset(original));
+    expectExif(readExif(updated), makeExif());
+    expectSameImage(readImage(updated), image);
+
+    // Updating again reuses the moved directory
+    const uint64_t offset = firstIfdOffset(updated);
+    ExifMetadata exif = makeExif();
+    exif.isoSpeedRatings = 800;
+    writer->writeExif(exif);
+
+    EXPECT_EQ(firstIfdOffset(stream.str()), offset);
+    expectExif(readExif(stream.str()), exif);
+}
+
+TEST(TiffTest, UpdateExifBigTiff) {
+    const Image16u image = makeImage(40, 30, PixelType::RGB);
+
+    ImageWriter::Options options;
+    options.tiffBigTiff = true;
+
+    std::stringstream stream;
+    const auto writer = io::makeWriter("test.tif", &stream, options);
+    writer->write(image);
+    ASSERT_EQ(readUInt(stream.str(), 2, 2), 43U);
+
+    writer->writeExif(makeExif());
+    expectExif(readExif(stream.str()), makeExif());
+    expectSameImage(readImage(stream.str()), image);
+}
+
+TEST(TiffTest, UpdateExifBigEndian) {
+    std::stringstream stream(makeBigEndianTiff());
+    io::makeWriter("test.tif", &stream)->writeExif(makeExif());
+
+    const std::string updated = stream.str();
+    EXPECT_EQ(updated.substr(0, 2), "MM");
+    expectExif(readExif(updated), makeExif());
+
+    std::istringstream input(updated);
+    const Image8u image = io::makeReader("test.tif", &input)->read8u();
+    ASSERT_EQ(image.width(), 4);
+    ASSERT_EQ(image.height(), 2);
+    for (int i = 0; i < 8; ++i) {
+        EXPECT_EQ(image(i % 4, i / 4, 0), 10 * i);
+    }
+}
+
+TEST(TiffTest, UpdateExifOutputStringStream) {
+    const Image16u image = makeImage(40, 30, PixelType::RGB);
+
+    std::ostringstream stream;
+    const auto writer = io::makeWriter("test.tif", &stream);
+    writer->write(image);
+    writer->writeExif(makeExif());
+
+    expectExif(readExif(stream.str()), makeExif());
+    expectSameImage(readImage(stream.str()), image);
+}
+
+TEST(TiffTest, RoiStartsOnCfaPeriod) {
+    for (auto [pixelType, period] : {std::pair{PixelType::RGB, 1},
+                                     std::pair{PixelType::BAYER_GRBG, 2},
+                                     std::pair{PixelType::QUADBAYER_GBRG, 4}}) {
+        SCOPED_TRACE(toString(pixelType));
+        const Image16u image = makeImage(40, 32, pixelType);
+        const std::string data = writeImage(image);
+
+        ImageReader::Options options;
+        options.roi = Rect{5, 7, 12, 10};
+
+        std::istringstream stream(data);
+        const auto reader = io::makeReader("test.tif", &stream, options);
+        const int x0 = 5 / period * period;
+        const int y0 = 7 / period * period;
+        EXPECT_EQ(reader->layoutDescriptor().width, 17 - x0);
+        EXPECT_EQ(reader->layoutDescriptor().height, 17 - y0);
+        expectRegion(reader->read16u(), image, x0, y0, 17 - x0, 17 - y0);
+    }
+}
+
+TEST(TiffTest, ReadRegionStartsOnCfaPeriod) {
+    for (auto [pixelType, period] : {std::pair{PixelType::RGB, 1},
+                                     std::pair{PixelType::BAYER_BGGR, 2},
+                                     std::pair{PixelType::QUADBAYER_GRBG, 4}}) {
+        SCOPED_TRACE(toString(pixelType));
+        const Image16u image = makeImage(40, 32, pixelType);
+
+        ImageWriter::Options options;
+        options.tiffTileSize = 16;
+        const std::string data = writeImage(image, options);
+
+        std::istringstream stream(data);
+        const auto reader = io::makeReader("test.tif", &stream);
+        const int x0 = 3 / period * period;
+        const int y0 = 6 / period * period;
+        expectRegion(reader->readRegion16u({3, 6, 20, 9}), image, x0, y0, 23 - x0, 15 - y0);
+    }
+}
+
+TEST(TiffTest, RoiOnReducedLevelStartsOnCfaPeriod) {
+    for (auto [pixelType, period] :
+         {std::pair{PixelType::BAYER_RGGB, 2}, std::pair{PixelType::QUADBAYER_BGGR, 4}}) {
+        SCOPED_TRACE(toString(pixelType));
+
+        ImageWriter::Options writeOptions;
+        writeOptions.tiffPyramidLevels = 1;
+        const std::string data = writeImage(makeImage(64, 64, pixelType), writeOptions);
+
+        ImageReader::Options options;
+        options.downscale = 2;
+
+        std::istringstream levelStream(data);
+        const Image16u level = io::makeReader("test.tif", &levelStream, options)->read16u();
+        ASSERT_EQ(level.width(), 32);
+
+        // (10, 14) is mapped to (5, 7) in the reduced level
+        options.roi = Rect{10, 14, 30, 20};
+        std::istringstream stream(data);
+        const int x0 = 5 / period * period;
+        const int y0 = 7 / period * period;
+        expectRegion(io::makeReader("test.tif", &stream, options)->read16u(), level, x0, y0, 20 - x0, 17 - y0);
+    }
+}
+
+TEST(TiffTest, PyramidRoundTrip) {
+    for (auto [pixelType, period] : {std::pair{PixelType::RGB, 1},
+                                     std::pair{PixelType::BAYER_GBRG, 2},
+                                     std::pair{PixelType::QUADBAYER_RGGB, 4}}) {
+        SCOPED_TRACE(toString(pixelType));
+        const Image16u image = makeImage(64, 48, pixelType);
+        const Image16u level1 = reduceByTwo(image, period);
+        const Image16u level2 = reduceByTwo(level1, period);
+        ASSERT_EQ(level2.width(), 16);
+        ASSERT_EQ(level2.height(), 12);
+
+        ImageWriter::Options writeOptions;
+        writeOptions.tiffPyramidLevels = 2;
+        writeOptions.tiffTileSize = 16;
+        const std::string data = writeImage(image, writeOptions);
+
+        // The downscale hint selects the smallest level at least as large as the downscaled image
+        for (auto [downscale, expected] : {std::pair{1, &image},
+                                           std::pair{2, &level1},
+                                           std::pair{3, &level1},
+                                           std::pair{4, &level2},
+                                           std::pair{8, &level2}}) {
+            SCOPED_TRACE("downscale " + std::to_string(downscale));
+            ImageReader::Options options;
+            options.downscale = downscale;
+
+            std::istringstream stream(data);
+            const auto reader = io::makeReader("test.tif", &stream, options);
+            EXPECT_EQ(reader->numLevels(), 3);
+            expectSameImage(reader->read16u(), *expected);
+        }
+    }
+}
+
+TEST(TiffTest, NoPyramid) {
+    std::istringstream stream(writeImage(makeImage(64, 48, PixelType::BAYER_RGGB)));
+
+    ImageReader::Options options;
+    options.downscale = 4;
+    const auto reader = io::makeReader("test.tif", &stream, options);
+    EXPECT_EQ(reader->numLevels(), 1);
+    EXPECT_EQ(reader->layoutDescriptor().width, 64);
+    EXPECT_EQ(reader->layoutDescriptor().height, 48);
+}
+
+TEST(TiffTest, ReadFrames) {
+    const fs::path path = fs::temp_directory_path() / "cxximg-tiff-frames.tif";
+    const std::vector<Image16u> pages = makePages();
+    writePages(path, pages);
+
+    for (bool prefetch : {false, true}) {
+        SCOPED_TRACE(prefetch ? "prefetch" : "no prefetch");
+        ImageReader::Options options;
+        options.prefetch = prefetch;
+
+        const auto reader = io::makeReader(path.string(), options);
+        ASSERT_EQ(reader->numFrames(), 3);
+
+        int index = 0;
+        for (const Image16u &frame : reader->frames<uint16_t>()) {
+            expectSameImage(frame, pages[index]);
+
+            // The next frame may be decoded in the background, metadata are still those of the current one
+            EXPECT_EQ(reader->layoutDescriptor().width, pages[index].width());
+            expectPageExif(reader->readExif(), index);
+            ++index;
+        }
+        EXPECT_EQ(index, 3);
+    }
+    fs::remove(path);
+}
+
+TEST(TiffTest, SelectFrameOutOfOrder) {
+    const fs::path path = fs::temp_directory_path() / "cxximg-tiff-select.tif";
+    const std::vector<Image16u> pages = makePages();
+    writePages(path, pages);
+
+    for (bool prefetch : {false, true}) {
+        SCOPED_TRACE(prefetch ? "prefetch" : "no prefetch");
+        ImageReader::Options options;
+        options.prefetch = prefetch;
+
+        const auto reader = io::makeReader(path.string(), options);
+        expectSameImage(reader->read16u(), pages[0]);
+
+        // Skip the prefetched frame
+        reader->selectFrame(2);
+        expectPageExif(reader->readExif(), 2);
+        expectSameImage(reader->read16u(), pages[2]);
+
+        // Go back, reading EXIF before the pixels
+        reader->selectFrame(1);
+        EXPECT_EQ(reader->layoutDescriptor().width, pages[1].width());
+        expectPageExif(reader->readExif(), 1);
+        expectSameImage(reader->read16u(), pages[1]);
+        expectPageExif(reader->readExif(), 1);
+
+        reader->selectFrame(2);
+        expectSameImage(reader->read16u(), pages[2]);
+        EXPECT_THROW(reader->selectFrame(3), IOError);
+    }
+    fs::remove(path);
+}
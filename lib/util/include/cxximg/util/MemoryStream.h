@@ -18,6 +18,12 @@ public:
         setp(buffer, buffer + size);
     }
 
+    /// Returns the whole underlying buffer.
+    const char* data() const { return eback(); }
+
+    /// Returns the size of the underlying buffer.
+    std::size_t size() const { return egptr() - eback(); }
+
 protected:
     pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
         return seekoff(pos, std::ios_base::beg, which);
@@ -44,28 +50,75 @@ protected:
     }
 };
 
-/// Custom stream buffer for writing to a dynamic vector
+/// Custom stream buffer for writing to a dynamic vector.
+/// Written data can be read back, and both positions can be sought, e.g. to patch a header after writing the data.
 class VectorStreamBuf : public std::streambuf {
 public:
     const std::vector<char>& vec() const { return mData; }
 
+protected:
     std::streamsize xsputn(const char* s, std::streamsize count) override {
-        const std::size_t oldSize = mData.size();
-        const std::size_t newSize = oldSize + count;
-
-        mData.resize(newSize);
-        char* dataPtr = mData.data();
+        const std::ptrdiff_t getOffset = gptr() - eback();
 
-        memcpy(dataPtr + oldSize, s, count);
+        if (mPut + count > mData.size()) {
+            mData.resize(mPut + count);
+        }
+        memcpy(mData.data() + mPut, s, count);
+        mPut += count;
 
-        setp(dataPtr, dataPtr + newSize);
-        pbump(static_cast<int>(newSize));
+        // The vector may have been reallocated
+        setg(mData.data(), mData.data() + getOffset, mData.data() + mData.size());
 
         return count;
     }
 
+    int_type overflow(int_type ch) override {
+        if (traits_type::eq_int_type(ch, traits_type::eof())) {
+            return traits_type::not_eof(ch);
+        }
+
+        const char c = traits_type::to_char_type(ch);
+        xsputn(&c, 1);
+        return ch;
+    }
+
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+        return seekoff(pos, std::ios_base::beg, which);
+    }
+
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+        const bool in = (which & std::ios_base::in) != 0;
+        const bool out = (which & std::ios_base::out) != 0;
+
+        off_type base = 0;
+        if (dir == std::ios_base::end) {
+            base = static_cast<off_type>(mData.size());
+        } else if (dir == std::ios_base::cur) {
+            if (in && out) {
+                return -1; // ambiguous position
+            }
+            base = in ? gptr() - eback() : static_cast<off_type>(mPut);
+        }
+
+        const off_type pos = base + off;
+        if (pos < 0 || (in && pos > static_cast<off_type>(mData.size()))) {
+            return -1; // invalid position
+        }
+
+        // Writing past the end fills the gap with zeros
+        if (out) {
+            mPut = static_cast<std::size_t>(pos);
+        }
+        if (in) {
+            setg(mData.data(), mData.data() + pos, mData.data() + mData.size());
+        }
+
+        return pos;
+    }
+
 private:
     std::vector<char> mData;
+    std::size_t mPut = 0;
 };
 
 /// Input stream using MemoryStreamBuf
@@ -75,6 +128,12 @@ public:
         this->init(&mBuffer);
     }
 
+    /// Returns the whole underlying buffer.
+    const char* data() const { return mBuffer.data(); }
+
+    /// Returns the size of the underlying buffer.
+    std::size_t size() const { return mBuffer.size(); }
+
 private:
     MemoryStreamBuf mBuffer;
 };
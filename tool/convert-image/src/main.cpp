@@ -36,6 +36,30 @@ inline void parse_value(const std::string& text, ImageWriter::TiffCompression& v
     value = *parsed;
 }
 
+inline void parse_value(const std::string& text, ImageWriter::DngCompression& value) {
+    const auto parsed = ImageWriter::parseDngCompression(text);
+    if (!parsed) {
+        throw cxxopts::exceptions::incorrect_argument_type(text);
+    }
+    value = *parsed;
+}
+
+inline void parse_value(const std::string& text, ImageWriter::PngProfile& value) {
+    const auto parsed = ImageWriter::parsePngProfile(text);
+    if (!parsed) {
+        throw cxxopts::exceptions::incorrect_argument_type(text);
+    }
+    value = *parsed;
+}
+
+inline void parse_value(const std::string& text, ImageWriter::CxiCompression& value) {
+    const auto parsed = ImageWriter::parseCxiCompression(text);
+    if (!parsed) {
+        throw cxxopts::exceptions::incorrect_argument_type(text);
+    }
+    value = *parsed;
+}
+
 } // namespace cxximg
 
 static cxxopts::ParseResult handleArguments(int argc, char* argv[]) {
@@ -54,8 +78,31 @@ static cxxopts::ParseResult handleArguments(int argc, char* argv[]) {
              {"tiff-compression",
               "TIFF output compression.",
               cxxopts::value<ImageWriter::TiffCompression>()->default_value("deflate"),
-              "deflate|none"},
+              "deflate|lzw|zstd|none"},
+             {"tiff-tile-size",
+              "TIFF output tile size, multiple of 16 (0: write strips).",
+              cxxopts::value<int>()->default_value("0")},
+             {"bigtiff", "Write BigTIFF output, even for images smaller than 4 GB."},
+             {"tiff-pyramid-levels",
+              "Number of 2x reduced resolution levels written after the TIFF image.",
+              cxxopts::value<int>()->default_value("0")},
+             {"dng-compression",
+              "DNG output compression.",
+              cxxopts::value<ImageWriter::DngCompression>()->default_value("lossless"),
+              "lossless|none"},
              {"compression-level", "Output compression level [1-9].", cxxopts::value<int>()->default_value("4")},
+             {"png-profile",
+              "PNG output filtering and deflate settings.",
+              cxxopts::value<ImageWriter::PngProfile>()->default_value("default"),
+              "default|fast|auto"},
+             {"png-parallel", "Deflate PNG output on all the encoding threads."},
+             {"cxi-compression",
+              "CXI output compression.",
+              cxxopts::value<ImageWriter::CxiCompression>()->default_value("none"),
+              "none|zstd|bayer"},
+             {"threads",
+              "Number of threads used for decoding and encoding (0: all cores).",
+              cxxopts::value<int>()->default_value("1")},
              {"v,verbosity",
               "Verbosity level.",
               cxxopts::value<std::string>()->default_value("WARNING"),
@@ -97,7 +144,10 @@ static void run(const std::string& inputPath,
     // Input
     std::optional<ImageMetadata> metadata = parser::readMetadata(inputPath, metadataPath);
 
-    std::unique_ptr<ImageReader> imageReader = io::makeReader(inputPath, ImageReader::Options(metadata));
+    ImageReader::Options readOptions(metadata);
+    readOptions.numThreads = writeOptions.numThreads;
+
+    std::unique_ptr<ImageReader> imageReader = io::makeReader(inputPath, readOptions);
     imageReader->readMetadata(metadata);
 
     // Forward input metadata to output
@@ -148,7 +198,15 @@ int main(int argc, char* argv[]) {
     ImageWriter::Options writeOptions;
     writeOptions.jpegQuality = args["jpeg-quality"].as<int>();
     writeOptions.tiffCompression = args["tiff-compression"].as<ImageWriter::TiffCompression>();
+    writeOptions.dngCompression = args["dng-compression"].as<ImageWriter::DngCompression>();
     writeOptions.compressionLevel = args["compression-level"].as<int>();
+    writeOptions.pngProfile = args["png-profile"].as<ImageWriter::PngProfile>();
+    writeOptions.tiffTileSize = args["tiff-tile-size"].as<int>();
+    writeOptions.tiffBigTiff = args.count("bigtiff") > 0;
+    writeOptions.tiffPyramidLevels = args["tiff-pyramid-levels"].as<int>();
+    writeOptions.numThreads = args["threads"].as<int>();
+    writeOptions.pngParallel = args.count("png-parallel") > 0;
+    writeOptions.cxiCompression = args["cxi-compression"].as<ImageWriter::CxiCompression>();
 
     try {
         run(inputPath, metadataPath, outputPath, writeOptions);